@@ -0,0 +1,746 @@
+// Differential accuracy harness : run the accelerated kernels in mathfunc.cpp and the plain glm float path
+// on random inputs (one in DEGENERATE is a degenerate case), and compare both with a double precision glm reference.
+//	math3d_accuracy [-n count] [-seed seed] [-maxulp ulp] [filter]
+// -maxulp : exit 1 if an accelerated kernel exceeds the max ulp error, or has more inf/nan mismatches than the glm path.
+// Cases without an accelerated kernel report the glm path only, as the error budget of a future kernel.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+
+extern "C" {
+	#include "linalg.h"
+	#include "math3dfunc.h"
+}
+
+#include "gettime.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/constants.hpp>
+
+#define CHUNK 4096
+#define MAXIN 32
+#define MAXOUT 16
+#define DEGENERATE 16
+// components smaller than ULP_FLOOR * the biggest component of the same value are measured by the absolute error only
+#define ULP_FLOOR 1e-5
+
+typedef void (*gen_func)(float *in, int degenerate);
+typedef void (*run_func)(struct lastack *LS, const float *in, float *out, int n);
+typedef void (*ref_func)(const float *in, double *out);
+
+struct acc_case {
+	const char *name;
+	int nin;
+	int nout;
+	int quat;	// offset of a quat in the output, q and -q are the same rotation. -1 if none
+	gen_func gen;
+	run_func kernel;	// accelerated kernel, NULL if there is only the glm path
+	run_func glm;
+	ref_func ref;
+};
+
+struct error_stat {
+	double ulp;
+	double abs;
+	uint64_t special;	// inf/nan mismatches
+	uint64_t time;
+};
+
+// random
+
+static uint64_t g_seed;
+
+static inline uint64_t
+rnd() {
+	g_seed ^= g_seed << 13;
+	g_seed ^= g_seed >> 7;
+	g_seed ^= g_seed << 17;
+	return g_seed;
+}
+
+static inline double
+uniform(double a, double b) {
+	return a + (b - a) * (double)(rnd() >> 11) / (double)(1ull << 53);
+}
+
+static inline int
+choice(int n) {
+	return (int)(rnd() % n);
+}
+
+// 10^[a,b], random sign
+static inline double
+magnitude(int a, int b) {
+	double v = pow(10.0, uniform(a, b));
+	return rnd() & 1 ? v : -v;
+}
+
+static void
+random_quat(glm::dquat &q) {
+	const double u1 = uniform(0, 1);
+	const double u2 = uniform(0, glm::two_pi<double>());
+	const double u3 = uniform(0, glm::two_pi<double>());
+	q.x = sqrt(1 - u1) * sin(u2);
+	q.y = sqrt(1 - u1) * cos(u2);
+	q.z = sqrt(u1) * sin(u3);
+	q.w = sqrt(u1) * cos(u3);
+}
+
+static void
+random_dir(double d[3]) {
+	glm::dvec3 v;
+	do {
+		v = glm::dvec3(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1));
+	} while (glm::dot(v, v) < 1e-4);
+	v = glm::normalize(v);
+	d[0] = v.x;
+	d[1] = v.y;
+	d[2] = v.z;
+}
+
+static void
+store_srt(float *mat, const double s[3], const glm::dquat &q, const double t[3]) {
+	glm::dmat3 r = glm::mat3_cast(q);
+	int i, j;
+	for (i=0;i<3;i++) {
+		for (j=0;j<3;j++) {
+			mat[i*4+j] = (float)(r[i][j] * s[i]);
+		}
+		mat[i*4+3] = 0;
+		mat[12+i] = (float)t[i];
+	}
+	mat[15] = 1;
+}
+
+static inline glm::dmat4
+load_mat(const float *m) {
+	glm::dmat4 r;
+	int i, j;
+	for (i=0;i<4;i++)
+		for (j=0;j<4;j++)
+			r[i][j] = m[i*4+j];
+	return r;
+}
+
+static inline glm::dquat
+load_quat(const float *q) {
+	glm::dquat r;
+	r.x = q[0];
+	r.y = q[1];
+	r.z = q[2];
+	r.w = q[3];
+	return r;
+}
+
+static inline void
+store_mat(double *out, const glm::dmat4 &m) {
+	int i, j;
+	for (i=0;i<4;i++)
+		for (j=0;j<4;j++)
+			out[i*4+j] = m[i][j];
+}
+
+// generators
+
+// scale * rotation + translation, degenerate : zero scale, identity scale, scale 1 +- ulps, near 180 degree rotation, extreme scales
+static void
+gen_srt(float *in, int degenerate) {
+	double s[3] = { uniform(0.01, 100), uniform(0.01, 100), uniform(0.01, 100) };
+	double t[3] = { uniform(-1000, 1000), uniform(-1000, 1000), uniform(-1000, 1000) };
+	glm::dquat q;
+	random_quat(q);
+	if (degenerate) {
+		switch (choice(5)) {
+		case 0:
+			s[choice(3)] = 0;
+			break;
+		case 1:
+			s[0] = s[1] = s[2] = 1;
+			break;
+		case 2:
+			s[0] = 1 + choice(9) * FLT_EPSILON * 0.5;
+			s[1] = 1 - choice(9) * FLT_EPSILON * 0.25;
+			s[2] = 1;
+			break;
+		case 3:
+			q.w = magnitude(-7, -2);
+			q = glm::normalize(q);
+			break;
+		case 4:
+			s[0] = 1e-4;
+			s[1] = 1e4;
+			break;
+		}
+	}
+	store_srt(in, s, q, t);
+}
+
+// affine, degenerate : uniform scale within the rigid tolerance of normal_matrix, exact uniform scale, near singular, sheared
+static void
+gen_affine(float *in, int degenerate) {
+	gen_srt(in, 0);
+	if (!degenerate)
+		return;
+	double s = uniform(0.1, 10);
+	double scale[3] = { s, s, s };
+	double t[3] = { uniform(-1000, 1000), uniform(-1000, 1000), uniform(-1000, 1000) };
+	glm::dquat q;
+	random_quat(q);
+	switch (choice(4)) {
+	case 0:
+		scale[choice(3)] *= 1 + uniform(-2e-6, 2e-6);
+		break;
+	case 1:
+		break;
+	case 2:
+		scale[choice(3)] = 1e-3;
+		break;
+	case 3: {
+		store_srt(in, scale, q, t);
+		int i = choice(3), j = (i + 1 + choice(2)) % 3;
+		in[i*4+j] += (float)uniform(-1, 1);
+		return; }
+	}
+	store_srt(in, scale, q, t);
+}
+
+// the same as gen_srt, plus near singular and large world translation
+static void
+gen_invertible(float *in, int degenerate) {
+	if (degenerate && choice(2)) {
+		double s[3] = { uniform(0.5, 2), uniform(0.5, 2), uniform(0.5, 2) };
+		double t[3] = { magnitude(4, 6), magnitude(4, 6), magnitude(4, 6) };
+		glm::dquat q;
+		random_quat(q);
+		if (choice(2))
+			s[choice(3)] = 1e-4;
+		store_srt(in, s, q, t);
+	} else {
+		gen_srt(in, 0);
+	}
+}
+
+static void
+gen_mat2(float *in, int degenerate) {
+	gen_srt(in, degenerate);
+	gen_srt(in + 16, 0);
+}
+
+// vector, degenerate : magnitude from denormal to near overflow, zero
+static void
+gen_vec(float *in, int degenerate) {
+	int i;
+	if (degenerate) {
+		double d[3];
+		random_dir(d);
+		double m = choice(8) ? fabs(magnitude(-20, 19)) : 0;
+		for (i=0;i<3;i++)
+			in[i] = (float)(d[i] * m);
+	} else {
+		for (i=0;i<3;i++)
+			in[i] = (float)uniform(-100, 100);
+	}
+	in[3] = (float)choice(2);
+}
+
+// reciprocal, degenerate : zero, -0, tiny and huge components
+static void
+gen_rcp(float *in, int degenerate) {
+	int i;
+	for (i=0;i<4;i++) {
+		if (degenerate) {
+			switch (choice(4)) {
+			case 0: in[i] = 0; break;
+			case 1: in[i] = -0.0f; break;
+			default: in[i] = (float)magnitude(-39, 38); break;
+			}
+		} else {
+			in[i] = (float)magnitude(-3, 3);
+		}
+	}
+}
+
+// unnormalized quat, degenerate : tiny, huge and zero
+static void
+gen_quat4(float *in, int degenerate) {
+	int i;
+	double m = degenerate ? (choice(8) ? fabs(magnitude(-19, 18)) : 0) : uniform(0.1, 10);
+	glm::dquat q;
+	random_quat(q);
+	in[0] = (float)(q.x * m);
+	in[1] = (float)(q.y * m);
+	in[2] = (float)(q.z * m);
+	in[3] = (float)(q.w * m);
+	for (i=0;i<4 && !degenerate;i++)
+		in[i] *= (float)uniform(0.9, 1.1);
+}
+
+static void
+gen_quat2(float *in, int degenerate) {
+	glm::dquat q;
+	random_quat(q);
+	in[0] = (float)q.x; in[1] = (float)q.y; in[2] = (float)q.z; in[3] = (float)q.w;
+	if (degenerate) {
+		// nearly the same and nearly opposite rotations
+		const double e = magnitude(-7, -3);
+		const double sign = choice(2) ? 1 : -1;
+		in[4] = (float)(sign * (q.x + e)); in[5] = (float)(sign * q.y); in[6] = (float)(sign * q.z); in[7] = (float)(sign * q.w);
+	} else {
+		random_quat(q);
+		in[4] = (float)q.x; in[5] = (float)q.y; in[6] = (float)q.z; in[7] = (float)q.w;
+	}
+}
+
+static void
+gen_quat_vec(float *in, int degenerate) {
+	glm::dquat q;
+	random_quat(q);
+	in[0] = (float)q.x; in[1] = (float)q.y; in[2] = (float)q.z; in[3] = (float)q.w;
+	gen_vec(in + 4, degenerate);
+}
+
+// point, degenerate : large world coordinates
+static void
+gen_point(float *in, int degenerate) {
+	int i;
+	for (i=0;i<3;i++)
+		in[i] = (float)(degenerate ? magnitude(5, 7) : uniform(-1000, 1000));
+	in[3] = 1;
+}
+
+// eye, at. degenerate : view direction near parallel to the up vector (0,1,0), sometimes exactly parallel
+static void
+gen_lookat(float *in, int degenerate) {
+	double d[3];
+	int i;
+	if (degenerate) {
+		const double e = choice(16) ? magnitude(-8, -1) : 0;
+		d[0] = e;
+		d[1] = choice(2) ? 1 : -1;
+		d[2] = choice(2) ? e : -e;
+	} else {
+		random_dir(d);
+	}
+	const double dist = uniform(0.1, 100);
+	for (i=0;i<3;i++) {
+		in[i] = (float)uniform(-1000, 1000);
+		in[4+i] = (float)(in[i] + d[i] * dist);
+	}
+	in[3] = in[7] = 1;
+}
+
+// left, right, bottom, top, near, far. degenerate : far / near up to 1e11, very narrow
+static void
+gen_frustum(float *in, int degenerate) {
+	double n = uniform(0.01, 1);
+	double f = uniform(10, 10000);
+	double w = n * uniform(0.1, 2);
+	double h = n * uniform(0.1, 2);
+	if (degenerate) {
+		if (choice(2)) {
+			n = 1e-4;
+			f = 1e7;
+			w = h = n;
+		} else {
+			w = n * 1e-5;
+		}
+	}
+	const double cx = w * uniform(-0.2, 0.2);
+	const double cy = h * uniform(-0.2, 0.2);
+	in[0] = (float)(cx - w);
+	in[1] = (float)(cx + w);
+	in[2] = (float)(cy - h);
+	in[3] = (float)(cy + h);
+	in[4] = (float)n;
+	in[5] = (float)f;
+}
+
+// runners : accelerated kernels and glm path
+
+// f pushes one value on the stack for input v
+#define STACK_RUN(name, nin, nout, f) \
+static void \
+name(struct lastack *LS, const float *in, float *out, int n) { \
+	int i; \
+	for (i=0;i<n;i++) { \
+		const float *v = in + i * nin; \
+		f; \
+		memcpy(out + i * nout, lastack_value(LS, lastack_pop(LS), NULL), nout * sizeof(float)); \
+	} \
+	lastack_reset(LS); \
+}
+
+static void
+kernel_decompose(struct lastack *LS, const float *in, float *out, int n) {
+	int i;
+	for (i=0;i<n;i++) {
+		float *o = out + i * 12;
+		math3d_decompose_matrix_array(in + i * 16, 1, o, o + 4, o + 8);
+	}
+}
+
+static void
+glm_decompose(struct lastack *LS, const float *in, float *out, int n) {
+	int i;
+	for (i=0;i<n;i++) {
+		const float *v = in + i * 16;
+		float *o = out + i * 12;
+		math3d_decompose_scale(v, o);
+		math3d_decompose_rot(v, o + 4);
+		o[8] = v[12];
+		o[9] = v[13];
+		o[10] = v[14];
+		o[11] = 1;
+	}
+}
+
+static void
+kernel_normal_matrix(struct lastack *LS, const float *in, float *out, int n) {
+	math3d_normal_matrix_array(in, n, out, 9);
+}
+
+static void
+glm_normal_matrix(struct lastack *LS, const float *in, float *out, int n) {
+	int i;
+	for (i=0;i<n;i++) {
+		glm::mat3 m = glm::transpose(glm::inverse(glm::mat3(*(const glm::mat4 *)(in + i * 16))));
+		memcpy(out + i * 9, &m[0][0], 9 * sizeof(float));
+	}
+}
+
+static void
+kernel_length(struct lastack *LS, const float *in, float *out, int n) {
+	int i;
+	for (i=0;i<n;i++)
+		out[i] = math3d_length_fast(in + i * 4);
+}
+
+static void
+glm_length(struct lastack *LS, const float *in, float *out, int n) {
+	int i;
+	for (i=0;i<n;i++)
+		out[i] = math3d_length(in + i * 4);
+}
+
+STACK_RUN(kernel_normalize_vector, 4, 4, math3d_normalize_vector_fast(LS, v))
+STACK_RUN(glm_normalize_vector, 4, 4, math3d_normalize_vector(LS, v))
+STACK_RUN(kernel_normalize_quat, 4, 4, math3d_normalize_quat_fast(LS, v))
+STACK_RUN(glm_normalize_quat, 4, 4, math3d_normalize_quat(LS, v))
+STACK_RUN(kernel_reciprocal, 4, 4, math3d_reciprocal_fast(LS, v))
+STACK_RUN(glm_reciprocal, 4, 4, math3d_reciprocal(LS, v))
+
+// transform_array uses one matrix for all the points
+static float g_transform[16];
+
+static void
+kernel_transform(struct lastack *LS, const float *in, float *out, int n) {
+	math3d_transform_array(g_transform, in, 4, n, NULL, out, 4);
+}
+
+STACK_RUN(glm_transform, 4, 4, math3d_rotmat_transform(LS, g_transform, v))
+
+static void
+glm_mul_mat(struct lastack *LS, const float *in, float *out, int n) {
+	int i;
+	for (i=0;i<n;i++)
+		math3d_mul_object(LS, in + i * 32, in + i * 32 + 16, LINEAR_TYPE_MAT, LINEAR_TYPE_MAT, out + i * 16);
+}
+
+static void
+glm_mul_quat(struct lastack *LS, const float *in, float *out, int n) {
+	int i;
+	float tmp[16];
+	for (i=0;i<n;i++) {
+		math3d_mul_object(LS, in + i * 8, in + i * 8 + 4, LINEAR_TYPE_QUAT, LINEAR_TYPE_QUAT, tmp);
+		memcpy(out + i * 4, tmp, 4 * sizeof(float));
+	}
+}
+
+STACK_RUN(glm_quat_transform, 8, 4, math3d_quat_transform(LS, v, v + 4))
+STACK_RUN(glm_inverse, 16, 16, math3d_inverse_matrix(LS, v))
+STACK_RUN(glm_lookat, 8, 16, math3d_lookat_matrix(LS, 0, v, v + 4, NULL))
+STACK_RUN(glm_frustum, 6, 16, math3d_frustumLH(LS, v[0], v[1], v[2], v[3], v[4], v[5], 0))
+
+// double precision references, with the same conventions as mathfunc.cpp
+
+static void
+ref_decompose(const float *in, double *out) {
+	glm::dmat3 m(load_mat(in));
+	double s[3];
+	int i;
+	for (i=0;i<3;i++)
+		s[i] = glm::length(m[i]);
+	if (s[0] == 0 || s[1] == 0 || s[2] == 0) {
+		// invalid scale, use 1 instead
+		s[0] = s[1] = s[2] = 1;
+	}
+	for (i=0;i<3;i++) {
+		m[i] /= s[i];
+		out[i] = s[i];
+	}
+	out[3] = 0;
+	glm::dquat q = glm::quat_cast(m);
+	out[4] = q.x;
+	out[5] = q.y;
+	out[6] = q.z;
+	out[7] = q.w;
+	out[8] = in[12];
+	out[9] = in[13];
+	out[10] = in[14];
+	out[11] = 1;
+}
+
+static void
+ref_normal_matrix(const float *in, double *out) {
+	glm::dmat3 m = glm::transpose(glm::inverse(glm::dmat3(load_mat(in))));
+	int i, j;
+	for (i=0;i<3;i++)
+		for (j=0;j<3;j++)
+			out[i*3+j] = m[i][j];
+}
+
+static void
+ref_length(const float *in, double *out) {
+	out[0] = glm::length(glm::dvec3(in[0], in[1], in[2]));
+}
+
+static void
+ref_normalize_vector(const float *in, double *out) {
+	const double len = glm::length(glm::dvec3(in[0], in[1], in[2]));
+	out[0] = in[0] / len;
+	out[1] = in[1] / len;
+	out[2] = in[2] / len;
+	out[3] = in[3];
+}
+
+static void
+ref_normalize_quat(const float *in, double *out) {
+	const double len = glm::length(glm::dvec4(in[0], in[1], in[2], in[3]));
+	if (len <= 0) {
+		out[0] = out[1] = out[2] = 0;
+		out[3] = 1;
+		return;
+	}
+	int i;
+	for (i=0;i<4;i++)
+		out[i] = in[i] / len;
+}
+
+static void
+ref_reciprocal(const float *in, double *out) {
+	out[0] = 1.0 / in[0];
+	out[1] = 1.0 / in[1];
+	out[2] = 1.0 / in[2];
+	out[3] = in[3];
+}
+
+static void
+ref_transform(const float *in, double *out) {
+	glm::dvec4 r = load_mat(g_transform) * glm::dvec4(in[0], in[1], in[2], in[3]);
+	out[0] = r.x;
+	out[1] = r.y;
+	out[2] = r.z;
+	out[3] = r.w;
+}
+
+static void
+ref_mul_mat(const float *in, double *out) {
+	store_mat(out, load_mat(in) * load_mat(in + 16));
+}
+
+static void
+ref_mul_quat(const float *in, double *out) {
+	glm::dquat q = load_quat(in) * load_quat(in + 4);
+	out[0] = q.x;
+	out[1] = q.y;
+	out[2] = q.z;
+	out[3] = q.w;
+}
+
+static void
+ref_quat_transform(const float *in, double *out) {
+	glm::dvec4 r = load_quat(in) * glm::dvec4(in[4], in[5], in[6], in[7]);
+	out[0] = r.x;
+	out[1] = r.y;
+	out[2] = r.z;
+	out[3] = r.w;
+}
+
+static void
+ref_inverse(const float *in, double *out) {
+	store_mat(out, glm::inverse(load_mat(in)));
+}
+
+static void
+ref_lookat(const float *in, double *out) {
+	store_mat(out, glm::lookAtLH(
+		glm::dvec3(in[0], in[1], in[2]),
+		glm::dvec3(in[4], in[5], in[6]),
+		glm::dvec3(0, 1, 0)));
+}
+
+static void
+ref_frustum(const float *in, double *out) {
+	store_mat(out, glm::frustumLH_ZO<double>(in[0], in[1], in[2], in[3], in[4], in[5]));
+}
+
+static const struct acc_case cases[] = {
+	{ "decompose", 16, 12, 4, gen_srt, kernel_decompose, glm_decompose, ref_decompose },
+	{ "normal_matrix", 16, 9, -1, gen_affine, kernel_normal_matrix, glm_normal_matrix, ref_normal_matrix },
+	{ "length", 4, 1, -1, gen_vec, kernel_length, glm_length, ref_length },
+	{ "normalize_vector", 4, 4, -1, gen_vec, kernel_normalize_vector, glm_normalize_vector, ref_normalize_vector },
+	{ "normalize_quat", 4, 4, -1, gen_quat4, kernel_normalize_quat, glm_normalize_quat, ref_normalize_quat },
+	{ "reciprocal", 4, 4, -1, gen_rcp, kernel_reciprocal, glm_reciprocal, ref_reciprocal },
+	{ "transform_array", 4, 4, -1, gen_point, kernel_transform, glm_transform, ref_transform },
+	{ "mul_mat", 32, 16, -1, gen_mat2, NULL, glm_mul_mat, ref_mul_mat },
+	{ "mul_quat", 8, 4, -1, gen_quat2, NULL, glm_mul_quat, ref_mul_quat },
+	{ "quat_transform", 8, 4, -1, gen_quat_vec, NULL, glm_quat_transform, ref_quat_transform },
+	{ "inverse", 16, 16, -1, gen_invertible, NULL, glm_inverse, ref_inverse },
+	{ "lookat", 8, 16, -1, gen_lookat, NULL, glm_lookat, ref_lookat },
+	{ "frustum", 6, 16, -1, gen_frustum, NULL, glm_frustum, ref_frustum },
+	{ NULL },
+};
+
+// compare
+
+// the distance between two adjacent floats around v
+static inline double
+float_ulp(double v) {
+	v = fabs(v);
+	if (v < FLT_MIN)
+		return ldexp(1.0, -149);
+	return ldexp(1.0, ilogb(v) - 23);
+}
+
+static void
+compare(const struct acc_case *c, const float *out, const double *ref, struct error_stat *S) {
+	double r[MAXOUT];
+	double m = 0;
+	int i;
+	for (i=0;i<c->nout;i++) {
+		r[i] = ref[i];
+		if (std::isfinite(r[i]) && fabs(r[i]) > m)
+			m = fabs(r[i]);
+	}
+	if (c->quat >= 0) {
+		const double *q = r + c->quat;
+		const float *o = out + c->quat;
+		if (q[0] * o[0] + q[1] * o[1] + q[2] * o[2] + q[3] * o[3] < 0) {
+			for (i=0;i<4;i++)
+				r[c->quat + i] = -r[c->quat + i];
+		}
+	}
+	for (i=0;i<c->nout;i++) {
+		const float v = out[i];
+		const float rf = (float)r[i];
+		if (!std::isfinite(v) || !std::isfinite(rf)) {
+			if (!(std::isnan(v) && std::isnan(rf)) && v != rf)
+				++S->special;
+			continue;
+		}
+		const double err = fabs(v - r[i]);
+		if (err > S->abs)
+			S->abs = err;
+		if (fabs(r[i]) >= m * ULP_FLOOR) {
+			const double ulp = err / float_ulp(r[i]);
+			if (ulp > S->ulp)
+				S->ulp = ulp;
+		}
+	}
+}
+
+static void
+run_case(struct lastack *LS, const struct acc_case *c, int count, struct error_stat *kernel, struct error_stat *glm) {
+	static float in[CHUNK * MAXIN];
+	static float out[CHUNK * MAXOUT];
+	static double ref[MAXOUT];
+	int i, j;
+	memset(kernel, 0, sizeof(*kernel));
+	memset(glm, 0, sizeof(*glm));
+	for (i=0;i<count;i+=CHUNK) {
+		const int n = count - i < CHUNK ? count - i : CHUNK;
+		for (j=0;j<n;j++)
+			c->gen(in + j * c->nin, choice(DEGENERATE) == 0);
+		if (c->kernel) {
+			uint64_t t = gettime_ns();
+			c->kernel(LS, in, out, n);
+			kernel->time += gettime_ns() - t;
+			for (j=0;j<n;j++) {
+				c->ref(in + j * c->nin, ref);
+				compare(c, out + j * c->nout, ref, kernel);
+			}
+		}
+		uint64_t t = gettime_ns();
+		c->glm(LS, in, out, n);
+		glm->time += gettime_ns() - t;
+		for (j=0;j<n;j++) {
+			c->ref(in + j * c->nin, ref);
+			compare(c, out + j * c->nout, ref, glm);
+		}
+	}
+}
+
+int
+main(int argc, char *argv[]) {
+	int count = 1000000;
+	uint64_t seed = 1;
+	double maxulp = -1;
+	const char *filter = NULL;
+	int i;
+	for (i=1;i<argc;i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			count = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-maxulp") == 0 && i + 1 < argc) {
+			maxulp = atof(argv[++i]);
+		} else if (argv[i][0] == '-') {
+			fprintf(stderr, "Usage: %s [-n count] [-seed seed] [-maxulp ulp] [filter]\n", argv[0]);
+			return 1;
+		} else {
+			filter = argv[i];
+		}
+	}
+	if (count <= 0)
+		count = 1;
+
+	g_seed = seed * 0x9e3779b97f4a7c15ull + 1;
+	gen_srt(g_transform, 0);
+
+	printf("%-16s %10s %10s %10s %10s %9s %9s %9s %8s\n",
+		"case", "max ulp", "max abs", "glm ulp", "glm abs", "inf/nan", "ns", "glm ns", "speedup");
+	int fail = 0;
+	struct lastack *LS = lastack_new();
+	for (i=0;cases[i].name;i++) {
+		const struct acc_case *c = &cases[i];
+		if (filter && strstr(c->name, filter) == NULL)
+			continue;
+		// the same inputs for each case, whatever the filter is
+		g_seed = (seed + i) * 0x9e3779b97f4a7c15ull + 1;
+		struct error_stat k, g;
+		run_case(LS, c, count, &k, &g);
+		const double gns = (double)g.time / count;
+		if (c->kernel) {
+			const double kns = (double)k.time / count;
+			printf("%-16s %10.1f %10.3g %10.1f %10.3g %4llu/%-4llu %9.2f %9.2f %7.2fx\n",
+				c->name, k.ulp, k.abs, g.ulp, g.abs,
+				(unsigned long long)k.special, (unsigned long long)g.special,
+				kns, gns, kns > 0 ? gns / kns : 0);
+			if (maxulp >= 0 && (k.ulp > maxulp || k.special > g.special)) {
+				fprintf(stderr, "%s : max ulp %.1f, %llu inf/nan mismatches\n", c->name, k.ulp, (unsigned long long)k.special);
+				fail = 1;
+			}
+		} else {
+			printf("%-16s %10s %10s %10.1f %10.3g %4s/%-4llu %9s %9.2f %8s\n",
+				c->name, "-", "-", g.ulp, g.abs, "-", (unsigned long long)g.special, "-", gns, "-");
+		}
+	}
+	lastack_delete(LS);
+	return fail;
+}
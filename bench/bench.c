@@ -0,0 +1,344 @@
+// Native microbenchmark of lastack and mathfunc kernels, without lua.
+//	math3d_bench [-n iterations] [-json file] [filter]
+// -json - writes the baseline to stdout. filter is a substring of the case names.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "linalg.h"
+#include "math3dfunc.h"
+#include "gettime.h"
+
+// temps are released by lastack_reset every BATCH ops, the reset is not timed
+#define BATCH 256
+#define ARRAY_N 256
+#define RING 1024
+#define GROWTH_N 65536
+
+struct result {
+	const char *name;
+	double ns;	// per op
+	double max_ns;	// the slowest op, only for growth cases
+};
+
+typedef uint64_t (*bench_func)(struct lastack *LS, int n);
+
+static const float MAT[16] = {
+	2.0f, 0.0f, 0.0f, 0.0f,
+	0.0f, 1.7320508f, 1.0f, 0.0f,
+	0.0f, -1.0f, 1.7320508f, 0.0f,
+	1.0f, 2.0f, 3.0f, 1.0f,
+};
+static const float VEC[4] = { 1.0f, 2.0f, 3.0f, 1.0f };
+static const float VEC2[4] = { -4.0f, 0.5f, 2.0f, 0.0f };
+static const float QUAT[4] = { 0.0f, 0.258819f, 0.0f, 0.9659258f };
+static const float SCALE[4] = { 2.0f, 2.0f, 2.0f, 0.0f };
+
+static float g_mat_array[ARRAY_N * 16];
+static float g_vec_array[ARRAY_N * 4];
+static float g_out_array[ARRAY_N * 16];
+static volatile float g_sink;
+
+#define BENCH(name, body) \
+static uint64_t \
+b_##name(struct lastack *LS, int n) { \
+	uint64_t t = 0; \
+	int i, j; \
+	for (i=0;i<n;i+=BATCH) { \
+		uint64_t t0 = gettime_ns(); \
+		for (j=0;j<BATCH;j++) { body; } \
+		t += gettime_ns() - t0; \
+		lastack_reset(LS); \
+	} \
+	return t; \
+}
+
+// lastack
+
+BENCH(push_vec4, lastack_pushvec4(LS, VEC))
+BENCH(push_quat, lastack_pushquat(LS, QUAT))
+BENCH(push_matrix, lastack_pushmatrix(LS, MAT))
+BENCH(push_srt, lastack_pushsrt(LS, SCALE, QUAT, VEC))
+BENCH(push_pop, lastack_pushvec4(LS, VEC); lastack_pop(LS))
+BENCH(value_constant, g_sink = lastack_value(LS, lastack_constant(LINEAR_TYPE_MAT), NULL)[0])
+BENCH(value_temp, lastack_pushmatrix(LS, MAT); g_sink = lastack_value(LS, lastack_pop(LS), NULL)[0])
+BENCH(mark_unmark_vec4, lastack_pushvec4(LS, VEC); lastack_unmark(LS, lastack_mark(LS, lastack_pop(LS))))
+BENCH(mark_unmark_matrix, lastack_pushmatrix(LS, MAT); lastack_unmark(LS, lastack_mark(LS, lastack_pop(LS))))
+BENCH(reset, lastack_pushmatrix(LS, MAT); lastack_reset(LS))
+
+// mathfunc
+
+static float g_tmp[16];
+static float g_minv[4], g_maxv[4];
+
+BENCH(make_srt, math3d_make_srt(LS, SCALE, QUAT, VEC))
+BENCH(make_quat_from_euler, math3d_make_quat_from_euler(LS, 0.1f, 0.2f, 0.3f))
+BENCH(make_quat_from_axis, math3d_make_quat_from_axis(LS, VEC, 0.5f))
+BENCH(mul_mat_mat, math3d_mul_object(LS, MAT, MAT, LINEAR_TYPE_MAT, LINEAR_TYPE_MAT, g_tmp))
+BENCH(mul_quat_quat, math3d_mul_object(LS, QUAT, QUAT, LINEAR_TYPE_QUAT, LINEAR_TYPE_QUAT, g_tmp))
+BENCH(mul_mat_vec, math3d_mul_object(LS, MAT, VEC, LINEAR_TYPE_MAT, LINEAR_TYPE_VEC4, g_tmp))
+BENCH(add_vec, math3d_add_vec(LS, VEC, VEC2, g_tmp))
+BENCH(sub_vec, math3d_sub_vec(LS, VEC, VEC2, g_tmp))
+BENCH(decompose_matrix, math3d_decompose_matrix(LS, MAT))
+BENCH(decompose_matrix_array, math3d_decompose_matrix_array(g_mat_array, ARRAY_N, g_out_array, g_out_array + ARRAY_N * 4, g_out_array + ARRAY_N * 8))
+BENCH(decompose_rot, math3d_decompose_rot(MAT, g_tmp))
+BENCH(decompose_scale, math3d_decompose_scale(MAT, g_tmp))
+BENCH(quat_to_matrix, math3d_quat_to_matrix(LS, QUAT))
+BENCH(matrix_to_quat, math3d_matrix_to_quat(LS, MAT))
+BENCH(length, g_sink = math3d_length(VEC))
+BENCH(length_fast, g_sink = math3d_length_fast(VEC))
+BENCH(floor, math3d_floor(LS, VEC2))
+BENCH(ceil, math3d_ceil(LS, VEC2))
+BENCH(dot, g_sink = math3d_dot(VEC, VEC2))
+BENCH(cross, math3d_cross(LS, VEC, VEC2))
+BENCH(mulH, math3d_mulH(LS, MAT, VEC))
+BENCH(normalize_vector, math3d_normalize_vector(LS, VEC))
+BENCH(normalize_vector_fast, math3d_normalize_vector_fast(LS, VEC))
+BENCH(normalize_quat, math3d_normalize_quat(LS, QUAT))
+BENCH(normalize_quat_fast, math3d_normalize_quat_fast(LS, QUAT))
+BENCH(inverse_matrix, math3d_inverse_matrix(LS, MAT))
+BENCH(normal_matrix_array, math3d_normal_matrix_array(g_mat_array, ARRAY_N, g_out_array, 12))
+BENCH(inverse_quat, math3d_inverse_quat(LS, QUAT))
+BENCH(transpose_matrix, math3d_transpose_matrix(LS, MAT))
+BENCH(lookat_matrix, math3d_lookat_matrix(LS, 0, VEC, VEC2, NULL))
+BENCH(reciprocal, math3d_reciprocal(LS, VEC))
+BENCH(reciprocal_fast, math3d_reciprocal_fast(LS, VEC))
+BENCH(quat_to_viewdir, math3d_quat_to_viewdir(LS, QUAT))
+BENCH(rotmat_to_viewdir, math3d_rotmat_to_viewdir(LS, MAT))
+BENCH(viewdir_to_quat, math3d_viewdir_to_quat(LS, VEC2))
+BENCH(frustumLH, math3d_frustumLH(LS, -1, 1, -1, 1, 0.1f, 100.0f, 0))
+BENCH(orthoLH, math3d_orthoLH(LS, -1, 1, -1, 1, 0.1f, 100.0f, 0))
+BENCH(base_axes, math3d_base_axes(LS, VEC2))
+BENCH(quat_transform, math3d_quat_transform(LS, QUAT, VEC))
+BENCH(rotmat_transform, math3d_rotmat_transform(LS, MAT, VEC))
+BENCH(minmax, math3d_minmax(LS, MAT, VEC, g_minv, g_maxv))
+BENCH(minmax_array, math3d_minmax_array(MAT, g_vec_array, 4, ARRAY_N, g_minv, g_maxv))
+BENCH(transform_array, math3d_transform_array(MAT, g_vec_array, 4, ARRAY_N, NULL, g_out_array, 4))
+BENCH(lerp, math3d_lerp(LS, VEC, VEC2, 0.3f, g_tmp))
+BENCH(dir2radian, math3d_dir2radian(LS, VEC2, g_tmp))
+
+static const struct math3d_instruction g_program[] = {
+	{ MATH3D_OP_MUL_MAT, { 0, 1, 0 } },
+	{ MATH3D_OP_TRANSFORMH, { 3, 2, 0 } },
+	{ MATH3D_OP_INVERSE_MAT, { 3, 0, 0 } },
+};
+static const float *g_program_reg[6] = { MAT, MAT, VEC };
+static float g_program_result[3][16];
+
+BENCH(program_exec, math3d_program_exec(g_program, 3, g_program_reg, 3, g_program_result))
+
+// growth : the cost of each push and mark on a new lastack (including the clock overhead),
+// the slowest op is the pool growth spike
+static void
+growth(struct result *r, int matrix) {
+	struct lastack *LS = lastack_new();
+	uint64_t total = 0, maxt = 0;
+	int i;
+	for (i=0;i<GROWTH_N;i++) {
+		uint64_t t = gettime_ns();
+		if (matrix)
+			lastack_pushmatrix(LS, MAT);
+		else
+			lastack_pushvec4(LS, VEC);
+		lastack_mark(LS, lastack_pop(LS));
+		t = gettime_ns() - t;
+		total += t;
+		if (t > maxt)
+			maxt = t;
+	}
+	lastack_delete(LS);
+	r->ns = (double)total / GROWTH_N;
+	r->max_ns = (double)maxt;
+}
+
+// blob churn : keep RING marked values alive, replace the oldest one each op
+static void
+blob_churn(struct result *r, int n) {
+	struct lastack *LS = lastack_new();
+	int64_t ring[RING];
+	int i;
+	for (i=0;i<RING;i++) {
+		lastack_pushvec4(LS, VEC);
+		ring[i] = lastack_mark(LS, lastack_pop(LS));
+	}
+	lastack_reset(LS);
+	uint64_t total = 0;
+	int j, k = 0;
+	for (i=0;i<n;i+=BATCH) {
+		uint64_t t = gettime_ns();
+		for (j=0;j<BATCH;j++) {
+			lastack_unmark(LS, ring[k]);
+			lastack_pushvec4(LS, VEC);
+			ring[k] = lastack_mark(LS, lastack_pop(LS));
+			k = (k + 1) % RING;
+		}
+		total += gettime_ns() - t;
+		lastack_reset(LS);
+	}
+	lastack_delete(LS);
+	r->ns = (double)total / n;
+	r->max_ns = 0;
+}
+
+#define CASE(name) { #name, b_##name }
+
+static const struct {
+	const char *name;
+	bench_func f;
+} cases[] = {
+	CASE(push_vec4),
+	CASE(push_quat),
+	CASE(push_matrix),
+	CASE(push_srt),
+	CASE(push_pop),
+	CASE(value_constant),
+	CASE(value_temp),
+	CASE(mark_unmark_vec4),
+	CASE(mark_unmark_matrix),
+	CASE(reset),
+	CASE(make_srt),
+	CASE(make_quat_from_euler),
+	CASE(make_quat_from_axis),
+	CASE(mul_mat_mat),
+	CASE(mul_quat_quat),
+	CASE(mul_mat_vec),
+	CASE(add_vec),
+	CASE(sub_vec),
+	CASE(decompose_matrix),
+	CASE(decompose_matrix_array),
+	CASE(decompose_rot),
+	CASE(decompose_scale),
+	CASE(quat_to_matrix),
+	CASE(matrix_to_quat),
+	CASE(length),
+	CASE(length_fast),
+	CASE(floor),
+	CASE(ceil),
+	CASE(dot),
+	CASE(cross),
+	CASE(mulH),
+	CASE(normalize_vector),
+	CASE(normalize_vector_fast),
+	CASE(normalize_quat),
+	CASE(normalize_quat_fast),
+	CASE(inverse_matrix),
+	CASE(normal_matrix_array),
+	CASE(inverse_quat),
+	CASE(transpose_matrix),
+	CASE(lookat_matrix),
+	CASE(reciprocal),
+	CASE(reciprocal_fast),
+	CASE(quat_to_viewdir),
+	CASE(rotmat_to_viewdir),
+	CASE(viewdir_to_quat),
+	CASE(frustumLH),
+	CASE(orthoLH),
+	CASE(base_axes),
+	CASE(quat_transform),
+	CASE(rotmat_transform),
+	CASE(minmax),
+	CASE(minmax_array),
+	CASE(transform_array),
+	CASE(lerp),
+	CASE(dir2radian),
+	CASE(program_exec),
+	{ NULL, NULL },
+};
+
+static void
+init_arrays() {
+	int i;
+	for (i=0;i<ARRAY_N;i++) {
+		memcpy(g_mat_array + i * 16, MAT, sizeof(MAT));
+		g_mat_array[i * 16 + 12] = (float)i;
+		g_vec_array[i * 4 + 0] = (float)i;
+		g_vec_array[i * 4 + 1] = (float)-i;
+		g_vec_array[i * 4 + 2] = (float)(i % 7);
+		g_vec_array[i * 4 + 3] = 1.0f;
+	}
+}
+
+static void
+write_json(FILE *f, int n, const struct result *r, int count) {
+	int i;
+	fprintf(f, "{\n\t\"iterations\" : %d,\n\t\"batch\" : %d,\n\t\"array\" : %d,\n\t\"results\" : {\n", n, BATCH, ARRAY_N);
+	for (i=0;i<count;i++) {
+		fprintf(f, "\t\t\"%s\" : { \"ns\" : %.3f", r[i].name, r[i].ns);
+		if (r[i].max_ns > 0)
+			fprintf(f, ", \"max_ns\" : %.0f", r[i].max_ns);
+		fprintf(f, " }%s\n", i == count - 1 ? "" : ",");
+	}
+	fprintf(f, "\t}\n}\n");
+}
+
+int
+main(int argc, char *argv[]) {
+	int n = 1000000;
+	const char *json = NULL;
+	const char *filter = NULL;
+	int i;
+	for (i=1;i<argc;i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			n = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc) {
+			json = argv[++i];
+		} else if (argv[i][0] == '-') {
+			fprintf(stderr, "Usage: %s [-n iterations] [-json file] [filter]\n", argv[0]);
+			return 1;
+		} else {
+			filter = argv[i];
+		}
+	}
+	n = (n + BATCH - 1) / BATCH * BATCH;
+	if (n <= 0)
+		n = BATCH;
+	init_arrays();
+
+	static struct result results[sizeof(cases) / sizeof(cases[0]) + 3];
+	int count = 0;
+	struct lastack *LS = lastack_new();
+	for (i=0;cases[i].name;i++) {
+		if (filter && strstr(cases[i].name, filter) == NULL)
+			continue;
+		cases[i].f(LS, BATCH);	// warm up
+		struct result *r = &results[count++];
+		r->name = cases[i].name;
+		r->ns = (double)cases[i].f(LS, n) / n;
+		r->max_ns = 0;
+	}
+	lastack_delete(LS);
+
+	if (filter == NULL || strstr("growth_vec4", filter)) {
+		results[count].name = "growth_vec4";
+		growth(&results[count++], 0);
+	}
+	if (filter == NULL || strstr("growth_matrix", filter)) {
+		results[count].name = "growth_matrix";
+		growth(&results[count++], 1);
+	}
+	if (filter == NULL || strstr("blob_churn", filter)) {
+		results[count].name = "blob_churn";
+		blob_churn(&results[count++], n);
+	}
+
+	for (i=0;i<count;i++) {
+		if (results[i].max_ns > 0)
+			printf("%-24s %10.3f ns/op  (max %.0f ns)\n", results[i].name, results[i].ns, results[i].max_ns);
+		else
+			printf("%-24s %10.3f ns/op\n", results[i].name, results[i].ns);
+	}
+
+	if (json) {
+		FILE *f = strcmp(json, "-") == 0 ? stdout : fopen(json, "w");
+		if (f == NULL) {
+			fprintf(stderr, "Can't open %s\n", json);
+			return 1;
+		}
+		write_json(f, n, results, count);
+		if (f != stdout)
+			fclose(f);
+	}
+	return 0;
+}
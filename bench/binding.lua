@@ -0,0 +1,301 @@
+-- lua bench/binding.lua [N] [filter]
+-- Time the lua binding of math3d : each exported function (it raises an error when an exported function has no case)
+-- and adapter kind with id (lightuserdata), ref and table arguments, and some scene frame workloads (hierarchy update, culling, skinning).
+
+local math3d = require "math3d"
+local adapter = require "math3d.adapter"
+local testfunc = require "math3d.adapter.test"
+
+local N, filter = ...
+N = tonumber(N) or 100000
+local BATCH = 1000	-- math3d.reset() every BATCH calls, not timed
+local NODES = 10000
+local FRAMES = 10
+
+local function value(v)
+	local r = math3d.ref(v)
+	return { id = r.i, ref = r, table = nil }
+end
+
+local args = {
+	v = value(math3d.vector(1, 2, 3, 0)),
+	p = value(math3d.vector(4, 5, 6, 1)),
+	q = value(math3d.quaternion { axis = {0,1,0}, r = math.rad(30) }),
+	m = value(math3d.matrix { s = 2, r = { axis = {0,1,0}, r = math.rad(30) }, t = { 1,2,3 } }),
+}
+args.v.table = { 1, 2, 3, 0 }
+args.p.table = { 4, 5, 6, 1 }
+args.q.table = { axis = {0,1,0}, r = math.rad(30) }
+args.m.table = { s = 2, r = { axis = {0,1,0}, r = math.rad(30) }, t = { 1,2,3 } }
+
+local forms = { "id", "ref", "table" }
+
+local runner = {
+	[0] = function(f, n) for _ = 1, n do f() end end,
+	function(f, n, a) for _ = 1, n do f(a) end end,
+	function(f, n, a, b) for _ = 1, n do f(a, b) end end,
+	function(f, n, a, b, c) for _ = 1, n do f(a, b, c) end end,
+	function(f, n, a, b, c, d) for _ = 1, n do f(a, b, c, d) end end,
+}
+
+-- returns ns per call, temps per call ; nil if f doesn't accept the arguments
+local function bench(f, argv)
+	local n = #argv
+	if not pcall(f, table.unpack(argv, 1, n)) then
+		return
+	end
+	local run = runner[n]
+	math3d.reset()
+	run(f, BATCH, table.unpack(argv, 1, n))
+	local _, temps = math3d.stacksize()
+	local t = 0
+	for _ = 1, N // BATCH do
+		math3d.reset()
+		local c = os.clock()
+		run(f, BATCH, table.unpack(argv, 1, n))
+		t = t + os.clock() - c
+	end
+	math3d.reset()
+	return t * 1e9 / (N // BATCH * BATCH), temps / BATCH
+end
+
+-- name, function, arguments : "v" vector, "p" point, "q" quat, "m" matrix are expanded to each form, others are passed as is
+local cases = {
+	{ "vector", math3d.vector, "v" },
+	{ "quaternion", math3d.quaternion, "q" },
+	{ "matrix", math3d.matrix, "m" },
+	{ "tostring", math3d.tostring, "m" },
+	{ "index", math3d.index, "v", 2 },
+	{ "mul(m,m)", math3d.mul, "m", "m" },
+	{ "mul(q,q)", math3d.mul, "q", "q" },
+	{ "mul(v,n)", math3d.mul, "v", 2.5 },
+	{ "add", math3d.add, "v", "v" },
+	{ "sub", math3d.sub, "v", "v" },
+	{ "muladd", math3d.muladd, "v", "v", "p" },
+	{ "srt", math3d.srt, "m" },
+	{ "length", math3d.length, "v" },
+	{ "floor", math3d.floor, "v" },
+	{ "ceil", math3d.ceil, "v" },
+	{ "dot", math3d.dot, "v", "v" },
+	{ "cross", math3d.cross, "v", "v" },
+	{ "normalize(v)", math3d.normalize, "v" },
+	{ "normalize(q)", math3d.normalize, "q" },
+	{ "transpose", math3d.transpose, "m" },
+	{ "inverse(m)", math3d.inverse, "m" },
+	{ "inverse(q)", math3d.inverse, "q" },
+	{ "lookat", math3d.lookat, "p", "v" },
+	{ "lookto", math3d.lookto, "p", "v" },
+	{ "reciprocal", math3d.reciprocal, "v" },
+	{ "todirection", math3d.todirection, "q" },
+	{ "torotation", math3d.torotation, "v" },
+	{ "totable", math3d.totable, "m" },
+	{ "unpack", math3d.unpack, "m" },
+	{ "base_axes", math3d.base_axes, "v" },
+	{ "transform(q,v)", math3d.transform, "q", "v", 0 },
+	{ "transformH", math3d.transformH, "m", "p" },
+	{ "lerp", math3d.lerp, "v", "v", 0.5 },
+	{ "dir2radian", math3d.dir2radian, "v" },
+	{ "affine", math3d.affine, "m" },
+	{ "dualquat", math3d.dualquat, "m" },
+	{ "projmat", math3d.projmat, { fov = 60, aspect = 1, n = 0.1, f = 1000 } },
+	{ "ref", math3d.ref, "m" },
+	{ "refarray", math3d.refarray, 16 },
+	{ "reset", math3d.reset },
+	{ "stacksize", math3d.stacksize },
+	{ "homogeneous_depth", math3d.homogeneous_depth },
+	{ "precision", math3d.precision },
+	{ "profile", math3d.profile },
+	{ "alloc_report", math3d.alloc_report },
+	{ "trace(false)", math3d.trace, false },
+}
+
+-- not timed : name = reason
+local untimed = {
+	trace_dump = "writes a file",
+}
+
+-- arrays, batches and serialization
+do
+	local points = math3d.array("v", 16)
+	local out = math3d.array("v", 16)
+	local mats = math3d.array("m", 16)
+	local worlds = math3d.array("m", 16)
+	local dqs = math3d.array("d", 16)
+	local list = {}
+	for i = 1, 16 do
+		list[i] = { i, -i, i * 0.5, 1 }
+		points[i] = list[i]
+		mats[i] = { s = 1, r = { axis = {0,1,0}, r = i * 0.1 }, t = { i, 1, -i } }
+	end
+	local ptr, n, stride = dqs:pointer()
+	local s = math3d.serialize(args.m.ref, points)
+	local prog = math3d.program { input = "mv", { "transformH", 1, 2 } }
+	-- "v" and "m" are expanded to values, create dualquat arrays
+	table.insert(cases, { "array", math3d.array, "d", 16 })
+	table.insert(cases, { "view", math3d.view, ptr, n, stride, "d" })
+	table.insert(cases, { "minmax", math3d.minmax, points, "m" })
+	table.insert(cases, { "transform_array", math3d.transform_array, "m", points, out })
+	table.insert(cases, { "srt_array", math3d.srt_array, mats })
+	table.insert(cases, { "normal_array", math3d.normal_array, mats, "3x3" })
+	table.insert(cases, { "rebase_array", math3d.rebase_array, mats, { 1, 2, 3 }, worlds })
+	table.insert(cases, { "dualquat_array", math3d.dualquat_array, mats, dqs })
+	table.insert(cases, { "serialize", math3d.serialize, args.m.ref, points })
+	table.insert(cases, { "deserialize", math3d.deserialize, s })
+	table.insert(cases, { "program", math3d.program, { input = "mv", { "transformH", 1, 2 } } })
+	table.insert(cases, { "program()", prog, "m", "p" })
+	table.insert(cases, { "program:batch", prog.batch, prog, 16, "m", list })
+end
+
+-- ref metamethods
+do
+	local r = math3d.ref(args.m.ref)
+	local rv = math3d.ref(args.v.ref)
+	local function setter(key) return function(v) r[key] = v end end
+	local function getter(key) return function() return r[key] end end
+	table.insert(cases, { "ref.m=", setter "m", "m" })
+	table.insert(cases, { "ref.v=", function(v) rv.v = v end, "v" })
+	table.insert(cases, { "ref.s=", setter "s", "v" })
+	table.insert(cases, { "ref.r=", setter "r", "q" })
+	table.insert(cases, { "ref.t=", setter "t", "v" })
+	table.insert(cases, { "ref.i", getter "i" })
+	table.insert(cases, { "ref.s", getter "s" })
+	table.insert(cases, { "ref.t", getter "t" })
+	table.insert(cases, { "ref[4]", function() return r[4] end })
+end
+
+-- adapters
+table.insert(cases, { "adapter.vector", adapter.vector(testfunc.vector, 1), "v", "v" })
+table.insert(cases, { "adapter.matrix", adapter.matrix(testfunc.matrix1, 1, 1), "m" })
+table.insert(cases, { "adapter.variant", adapter.variant(testfunc.vector, testfunc.matrix1, 1), "m" })
+table.insert(cases, { "adapter.format", adapter.format(testfunc.matrix2, "mm", 1), "m", "m" })
+table.insert(cases, { "adapter.getter", adapter.getter(testfunc.getmvq, "mvq") })
+table.insert(cases, { "adapter.output_vector", adapter.output_vector(testfunc.retvec, 1) })
+do
+	local vector_array = adapter.array(testfunc.vector_array, 1, "v")
+	local points = {}
+	for i = 1, 16 do
+		points[i] = { i, i, i }
+	end
+	local arr = math3d.array("v", 16)
+	arr:copy(points)
+	table.insert(cases, { "adapter.array(table)", vector_array, points })
+	table.insert(cases, { "adapter.array(array)", vector_array, arr })
+end
+
+do
+	local covered = {}
+	for _, c in ipairs(cases) do
+		covered[c[2]] = true
+	end
+	local missing = {}
+	for name, f in pairs(math3d) do
+		if type(f) == "function" and not covered[f] and not untimed[name] then
+			missing[#missing+1] = name
+		end
+	end
+	if #missing > 0 then
+		table.sort(missing)
+		error("No bench case for math3d." .. table.concat(missing, ", math3d."))
+	end
+end
+
+local function match(name)
+	return filter == nil or name:find(filter, 1, true)
+end
+
+print(string.format("%-24s %-6s %12s %10s", "function", "form", "ns/call", "temps"))
+for _, c in ipairs(cases) do
+	local name, f = c[1], c[2]
+	if match(name) then
+		local expand = false
+		for i = 3, #c do
+			if args[c[i]] then
+				expand = true
+			end
+		end
+		for _, form in ipairs(expand and forms or { "-" }) do
+			local argv = {}
+			for i = 3, #c do
+				local a = args[c[i]]
+				argv[i-2] = a and a[form] or c[i]
+			end
+			local ns, temps = bench(f, argv)
+			if ns then
+				print(string.format("%-24s %-6s %10.1fns %10.2f", name, form, ns, temps))
+			else
+				print(string.format("%-24s %-6s %12s", name, form, "n/a"))
+			end
+		end
+	end
+end
+
+-- scene frame workloads
+
+local locals = math3d.refarray(NODES)
+local worlds = math3d.refarray(NODES)
+local invbind = math3d.refarray(NODES)
+local bones = math3d.array("m", NODES)
+local dqbones = math3d.array("d", NODES)
+local parent = {}
+for i = 1, NODES do
+	parent[i] = i // 4	-- 0 is root
+	locals:set(i, "m", { s = 1, r = { axis = {0,1,0}, r = i * 0.01 }, t = { i % 10, 1, i % 7 } })
+	invbind:set(i, "m", { t = { -(i % 10), -1, -(i % 7) } })
+end
+local viewproj = math3d.ref(math3d.mul(
+	math3d.projmat { fov = 60, aspect = 1, n = 0.1, f = 1000 },
+	math3d.lookat(math3d.vector(0, 50, -100), math3d.vector(0, 0, 0))))
+
+local visible = 0
+
+-- name, math3d calls (including metamethods) per node, frame function
+local scenes = {
+	{ "hierarchy", 4, function()
+		for i = 1, NODES do
+			local p = parent[i]
+			if p == 0 then
+				worlds[i] = locals[i]
+			else
+				worlds[i] = math3d.mul(worlds[p], locals[i])
+			end
+		end
+	end },
+	{ "culling", 4, function()
+		visible = 0
+		for i = 1, NODES do
+			local x, y, z = math3d.unpack(math3d.transformH(viewproj, math3d.index(worlds[i], 4)))
+			if x >= -1 and x <= 1 and y >= -1 and y <= 1 and z >= 0 and z <= 1 then
+				visible = visible + 1
+			end
+		end
+	end },
+	{ "skinning", 4, function()
+		for i = 1, NODES do
+			bones[i] = math3d.mul(worlds[i], invbind[i])
+		end
+	end },
+	{ "dq_palette", 1, function()
+		math3d.dualquat_array(bones, dqbones)
+	end },
+}
+
+print()
+print(string.format("%-12s %10s %14s %12s", "scene", "ms/frame", "calls/sec", "temps/frame"))
+for _, s in ipairs(scenes) do
+	local name, calls, frame = s[1], s[2], s[3]
+	if match(name) then
+		math3d.reset()
+		frame()
+		local _, temps = math3d.stacksize()
+		local t = 0
+		for _ = 1, FRAMES do
+			math3d.reset()
+			local c = os.clock()
+			frame()
+			t = t + os.clock() - c
+		end
+		math3d.reset()
+		t = t / FRAMES
+		print(string.format("%-12s %10.3f %14.0f %12d", name, t * 1000, calls * NODES / t, temps))
+	end
+end
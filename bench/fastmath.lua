@@ -0,0 +1,46 @@
+-- lua bench/fastmath.lua [N]
+-- Compare the cost per op of math3d (lua path), math3d.fastmath (lua path) and native fastmath calls.
+
+local math3d = require "math3d"
+local fastmath = require "math3d.fastmath"
+
+local N = tonumber(...) or 100000
+
+local m1 = math3d.ref(math3d.matrix { s = 2, r = { axis = {0,1,0}, r = math.rad(30) }, t = { 1,2,3 } })
+local m2 = math3d.ref(math3d.matrix { s = 1, r = { axis = {1,0,0}, r = math.rad(45) }, t = { 4,5,6 } })
+local v1 = math3d.ref(math3d.vector(1,2,3,0))
+local v2 = math3d.ref(math3d.vector(4,5,6,0))
+
+local function bench(name, f, a, b)
+	math3d.reset()
+	local t = os.clock()
+	for _ = 1, N do
+		f(a, b)
+	end
+	t = os.clock() - t
+	math3d.reset()
+	return t * 1e9 / N
+end
+
+local cases = {
+	{ "mul", m1, m2 },
+	{ "add", v1, v2 },
+	{ "cross", v1, v2 },
+	{ "inverse", m1 },
+	{ "transformH", m1, v1 },
+}
+
+print(string.format("%-12s %12s %12s %12s", "op", "math3d", "fastmath", "native"))
+for _, c in ipairs(cases) do
+	local name, a, b = c[1], c[2], c[3]
+	local lua_ns = bench(name, math3d[name], a, b)
+	local fast_ns = bench(name, fastmath[name], a, b)
+	local native_ns
+	if b then
+		native_ns = fastmath.bench(name, N, a, b)
+	else
+		native_ns = fastmath.bench(name, N, a)
+	end
+	math3d.reset()
+	print(string.format("%-12s %10.1fns %10.1fns %10.1fns", name, lua_ns, fast_ns, native_ns))
+end
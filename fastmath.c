@@ -0,0 +1,349 @@
+#define LUA_LIB
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "linalg.h"
+#include "math3d.h"
+#include "math3dfunc.h"
+#include "fastmath.h"
+#include "gettime.h"
+
+void
+fastmath_pushargs(lua_State *L, struct lastack *LS, struct ref_stack *RS) {
+	int top = lua_gettop(L);
+	int i;
+	for (i=1;i<=top;i++) {
+		int64_t id;
+		int ltype = lua_type(L, i);
+		if (ltype == LUA_TLIGHTUSERDATA) {
+			id = (int64_t)lua_touserdata(L, i);
+			refstack_push(RS);
+		} else if (ltype == LUA_TUSERDATA && lua_rawlen(L, i) == sizeof(struct refobject)) {
+			struct refobject *R = (struct refobject *)lua_touserdata(L, i);
+			id = R->id;
+			refstack_pushref(RS, i);
+		} else {
+			luaL_argerror(L, i, "Need math3d id or ref");
+			return;
+		}
+		if (lastack_pushref(LS, id))
+			luaL_argerror(L, i, "Invalid math3d id");
+	}
+}
+
+int
+fastmath_return(lua_State *L, struct lastack *LS, int base, int ret) {
+	int i;
+	lua_settop(L, ret);
+	for (i=ret;i>0;i--) {
+		lua_pushlightuserdata(L, (void *)lastack_pop(LS));
+		lua_replace(L, i);
+	}
+	// drop unused arguments
+	while (lastack_gettop(LS) > base) {
+		lastack_pop(LS);
+	}
+	return ret;
+}
+
+static const float *
+pop_value(lua_State *L, struct lastack *LS, int *type) {
+	int64_t id = lastack_pop(LS);
+	const float *v = lastack_value(LS, id, type);
+	if (v == NULL)
+		luaL_error(L, "Invalid math3d value on stack");
+	return v;
+}
+
+static const float *
+pop_type(lua_State *L, struct lastack *LS, int type) {
+	int t;
+	const float *v = pop_value(L, LS, &t);
+	if (t != type)
+		luaL_error(L, "Need a %s , it's a %s.", lastack_typename(type), lastack_typename(t));
+	return v;
+}
+
+FASTMATH(dup) {
+	if (lastack_dup(LS, 1) == 0)
+		return luaL_error(L, "Empty stack");
+	refstack_dup(RS, 1);
+	return 1;
+}
+
+FASTMATH(swap) {
+	if (lastack_swap(LS) == 0)
+		return luaL_error(L, "Need 2 values to swap");
+	refstack_swap(RS);
+	return 2;
+}
+
+FASTMATH(mul) {
+	int lt, rt;
+	float tmp[16];
+	const float *rv = pop_value(L, LS, &rt);
+	const float *lv = pop_value(L, LS, &lt);
+	int t = math3d_mul_object(LS, lv, rv, lt, rt, tmp);
+	if (t == LINEAR_TYPE_NONE)
+		return luaL_error(L, "Invalid mul arguments, ltype = %d rtype = %d", lt, rt);
+	lastack_pushobject(LS, tmp, t);
+	refstack_2_1(RS);
+	return 1;
+}
+
+FASTMATH(add) {
+	float tmp[4];
+	const float *rv = pop_type(L, LS, LINEAR_TYPE_VEC4);
+	const float *lv = pop_type(L, LS, LINEAR_TYPE_VEC4);
+	math3d_add_vec(LS, lv, rv, tmp);
+	lastack_pushvec4(LS, tmp);
+	refstack_2_1(RS);
+	return 1;
+}
+
+FASTMATH(sub) {
+	float tmp[4];
+	const float *rv = pop_type(L, LS, LINEAR_TYPE_VEC4);
+	const float *lv = pop_type(L, LS, LINEAR_TYPE_VEC4);
+	math3d_sub_vec(LS, lv, rv, tmp);
+	lastack_pushvec4(LS, tmp);
+	refstack_2_1(RS);
+	return 1;
+}
+
+FASTMATH(cross) {
+	const float *rv = pop_type(L, LS, LINEAR_TYPE_VEC4);
+	const float *lv = pop_type(L, LS, LINEAR_TYPE_VEC4);
+	math3d_cross(LS, lv, rv);
+	refstack_2_1(RS);
+	return 1;
+}
+
+FASTMATH(normalize) {
+	int type;
+	const float *v = pop_value(L, LS, &type);
+	switch (type) {
+	case LINEAR_TYPE_VEC4:
+		math3d_normalize_vector(LS, v);
+		break;
+	case LINEAR_TYPE_QUAT:
+		math3d_normalize_quat(LS, v);
+		break;
+	case LINEAR_TYPE_DUALQUAT:
+		math3d_normalize_dualquat(LS, v);
+		break;
+	default:
+		return luaL_error(L, "normalize don't support %s", lastack_typename(type));
+	}
+	refstack_1_1(RS);
+	return 1;
+}
+
+FASTMATH(inverse) {
+	int type;
+	const float *v = pop_value(L, LS, &type);
+	switch (type) {
+	case LINEAR_TYPE_VEC4: {
+		float iv[4] = { -v[0], -v[1], -v[2], v[3] };
+		lastack_pushvec4(LS, iv);
+		break; }
+	case LINEAR_TYPE_QUAT:
+		math3d_inverse_quat(LS, v);
+		break;
+	case LINEAR_TYPE_MAT:
+		math3d_inverse_matrix(LS, v);
+		break;
+	case LINEAR_TYPE_AFFINE:
+		math3d_inverse_affine(LS, v);
+		break;
+	case LINEAR_TYPE_DUALQUAT:
+		math3d_inverse_dualquat(LS, v);
+		break;
+	default:
+		return luaL_error(L, "inverse don't support %s", lastack_typename(type));
+	}
+	refstack_1_1(RS);
+	return 1;
+}
+
+FASTMATH(transpose) {
+	const float *m = pop_type(L, LS, LINEAR_TYPE_MAT);
+	math3d_transpose_matrix(LS, m);
+	refstack_1_1(RS);
+	return 1;
+}
+
+// rotator (quat/mat/affine/dualquat), vector
+FASTMATH(transform) {
+	int type;
+	const float *v = pop_type(L, LS, LINEAR_TYPE_VEC4);
+	const float *rotator = pop_value(L, LS, &type);
+	switch (type) {
+	case LINEAR_TYPE_QUAT:
+		math3d_quat_transform(LS, rotator, v);
+		break;
+	case LINEAR_TYPE_MAT:
+		math3d_rotmat_transform(LS, rotator, v);
+		break;
+	case LINEAR_TYPE_AFFINE:
+		math3d_affine_transform(LS, rotator, v);
+		break;
+	case LINEAR_TYPE_DUALQUAT:
+		math3d_dualquat_transform(LS, rotator, v);
+		break;
+	default:
+		return luaL_error(L, "only support quat/mat/affine/dualquat for rotate vector:%s", lastack_typename(type));
+	}
+	refstack_2_1(RS);
+	return 1;
+}
+
+FASTMATH(transformH) {
+	const float *v = pop_type(L, LS, LINEAR_TYPE_VEC4);
+	const float *m = pop_type(L, LS, LINEAR_TYPE_MAT);
+	math3d_mulH(LS, m, v);
+	refstack_2_1(RS);
+	return 1;
+}
+
+// eye, at, up
+FASTMATH(lookat) {
+	const float *up = pop_type(L, LS, LINEAR_TYPE_VEC4);
+	const float *at = pop_type(L, LS, LINEAR_TYPE_VEC4);
+	const float *eye = pop_type(L, LS, LINEAR_TYPE_VEC4);
+	math3d_lookat_matrix(LS, 0, eye, at, up);
+	refstack_pop(RS);
+	refstack_2_1(RS);
+	return 1;
+}
+
+FASTMATH(matrix) {
+	const float *q = pop_type(L, LS, LINEAR_TYPE_QUAT);
+	math3d_quat_to_matrix(LS, q);
+	refstack_1_1(RS);
+	return 1;
+}
+
+FASTMATH(quaternion) {
+	const float *m = pop_type(L, LS, LINEAR_TYPE_MAT);
+	math3d_matrix_to_quat(LS, m);
+	refstack_1_1(RS);
+	return 1;
+}
+
+static const struct mfunction_reg native_functions[] = {
+	{ MFUNCTION_NATIVE(dup) },
+	{ MFUNCTION_NATIVE(swap) },
+	{ MFUNCTION_NATIVE(mul) },
+	{ MFUNCTION_NATIVE(add) },
+	{ MFUNCTION_NATIVE(sub) },
+	{ MFUNCTION_NATIVE(cross) },
+	{ MFUNCTION_NATIVE(normalize) },
+	{ MFUNCTION_NATIVE(inverse) },
+	{ MFUNCTION_NATIVE(transpose) },
+	{ MFUNCTION_NATIVE(transform) },
+	{ MFUNCTION_NATIVE(transformH) },
+	{ MFUNCTION_NATIVE(lookat) },
+	{ MFUNCTION_NATIVE(matrix) },
+	{ MFUNCTION_NATIVE(quaternion) },
+	{ NULL, NULL },
+};
+
+MFunction
+fastmath_function(const char *name) {
+	const struct mfunction_reg *r;
+	for (r = native_functions; r->name; r++) {
+		if (strcmp(r->name, name) == 0)
+			return r->func;
+	}
+	return NULL;
+}
+
+// bench(name, n, args...) : call native function n times, returns ns per call.
+// The results are temps in the math stack, call math3d.reset() after.
+static int
+lbench(lua_State *L) {
+	struct lastack *LS = getLS(L, 1);
+	const char *name = luaL_checkstring(L, 1);
+	int n = (int)luaL_checkinteger(L, 2);
+	MFunction f = fastmath_function(name);
+	if (f == NULL)
+		return luaL_error(L, "Invalid fastmath function %s", name);
+	int top = lua_gettop(L);
+	int64_t args[16];
+	int nargs = top - 2;
+	int i, j;
+	if (nargs > 16)
+		return luaL_error(L, "Too many arguments");
+	for (i=0;i<nargs;i++) {
+		int ltype = lua_type(L, i+3);
+		if (ltype == LUA_TLIGHTUSERDATA) {
+			args[i] = (int64_t)lua_touserdata(L, i+3);
+		} else if (ltype == LUA_TUSERDATA && lua_rawlen(L, i+3) == sizeof(struct refobject)) {
+			args[i] = ((struct refobject *)lua_touserdata(L, i+3))->id;
+		} else {
+			return luaL_argerror(L, i+3, "Need math3d id or ref");
+		}
+	}
+	struct ref_stack RS;
+	refstack_init(&RS, L);
+	int base = lastack_gettop(LS);
+	uint64_t t = gettime_ns();
+	for (i=0;i<n;i++) {
+		for (j=0;j<nargs;j++) {
+			lastack_pushref(LS, args[j]);
+			refstack_push(&RS);
+		}
+		int ret = f(NULL, LS, &RS);
+		for (j=0;j<ret;j++) {
+			lastack_pop(LS);
+			refstack_pop(&RS);
+		}
+	}
+	t = gettime_ns() - t;
+	while (lastack_gettop(LS) > base) {
+		lastack_pop(LS);
+	}
+	lua_pushnumber(L, n > 0 ? (double)t / n : 0);
+	return 1;
+}
+
+LUAMOD_API int
+luaopen_math3d_fastmath(lua_State *L) {
+	luaL_checkversion(L);
+
+	luaL_Reg l[] = {
+		{ MFUNCTION(dup) },
+		{ MFUNCTION(swap) },
+		{ MFUNCTION(mul) },
+		{ MFUNCTION(add) },
+		{ MFUNCTION(sub) },
+		{ MFUNCTION(cross) },
+		{ MFUNCTION(normalize) },
+		{ MFUNCTION(inverse) },
+		{ MFUNCTION(transpose) },
+		{ MFUNCTION(transform) },
+		{ MFUNCTION(transformH) },
+		{ MFUNCTION(lookat) },
+		{ MFUNCTION(matrix) },
+		{ MFUNCTION(quaternion) },
+		{ "bench", lbench },
+		{ NULL, NULL },
+	};
+
+	luaL_newlibtable(L, l);
+
+	if (lua_getfield(L, LUA_REGISTRYINDEX, MATH3D_STACK) != LUA_TUSERDATA) {
+		return luaL_error(L, "request 'math3d' first");
+	}
+	struct boxstack * bs = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	lua_pushlightuserdata(L, bs->LS);
+
+	luaL_setfuncs(L,l,1);
+
+	return 1;
+}
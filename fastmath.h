@@ -3,21 +3,69 @@
 
 #include <lua.h>
 #include "linalg.h"
+#include "math3d.h"
 #include "refstack.h"
 
+// MFunction works on the top of lastack :
+//	native call : m_f(NULL, LS, RS), arguments are pushed into LS (and tracked by RS) before call,
+//		the results are left on the top of LS. RS->L is used for raising errors.
+//	lua call : m_f(L, NULL, NULL), arguments are math3d values on lua stack, LS is upvalue 1,
+//		the results are returned as math3d ids.
+// returns the number of results.
+
 typedef int (*MFunction)(lua_State *L, struct lastack *LS, struct ref_stack *RS);
 
+struct mfunction_reg {
+	const char *name;
+	MFunction func;
+};
+
+static inline struct lastack *
+getLS(lua_State *L, int index) {
+	struct lastack *LS = (struct lastack *)lua_touserdata(L, lua_upvalueindex(index));
+	math3d_setcaller(L, LS);
+	return LS;
+}
+
+void fastmath_pushargs(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int fastmath_return(lua_State *L, struct lastack *LS, int base, int ret);
+
 #define FASTMATH(f)\
+static int f_##f(lua_State *L, struct lastack *LS, struct ref_stack *RS);\
 int m_##f(lua_State *L, struct lastack *LS_, struct ref_stack *RS_) {\
-	struct ref_stack tmpRS; \
-	struct lastack *LS;\
-	struct ref_stack *RS;\
-	if (L == NULL) {\
-		L = RS_->L; LS=LS_; RS=RS_; (void)LS; (void)RS;\
-	} else {\
-		LS = getLS(L, 1); refstack_init(&tmpRS, L); RS = &tmpRS;\
-	}
-
-#define MFUNCTION(f) #f, (lua_CFunction)( m_##f )
+	struct ref_stack tmpRS;\
+	if (L == NULL)\
+		return f_##f(RS_->L, LS_, RS_);\
+	struct lastack *LS = getLS(L, 1);\
+	int base = lastack_gettop(LS);\
+	refstack_init(&tmpRS, L);\
+	fastmath_pushargs(L, LS, &tmpRS);\
+	return fastmath_return(L, LS, base, f_##f(L, LS, &tmpRS));\
+}\
+static int l_##f(lua_State *L) { return m_##f(L, NULL, NULL); }\
+static int f_##f(lua_State *L, struct lastack *LS, struct ref_stack *RS)
+
+#define MFUNCTION(f) #f, l_##f
+#define MFUNCTION_NATIVE(f) #f, m_##f
+
+// native entries
+
+int m_dup(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_swap(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_mul(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_add(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_sub(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_cross(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_normalize(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_inverse(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_transpose(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_transform(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_transformH(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_lookat(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_matrix(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+int m_quaternion(lua_State *L, struct lastack *LS, struct ref_stack *RS);
+
+// find a native entry by name, NULL if not exist
+MFunction fastmath_function(const char *name);
 
 #endif
@@ -0,0 +1,33 @@
+#ifndef math3d_gettime_h
+#define math3d_gettime_h
+
+#include <stdint.h>
+
+// monotonic clock in nanoseconds, for benchmarks
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+static inline uint64_t
+gettime_ns() {
+	LARGE_INTEGER freq, counter;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)((double)counter.QuadPart * 1e9 / freq.QuadPart);
+}
+
+#else
+
+#include <time.h>
+
+static inline uint64_t
+gettime_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif
+
+#endif
@@ -3,12 +3,16 @@
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <limits.h>
 #include "linalg.h"
+#include "trace.h"
 
 #define MINCAP 128
 
 #define VECTOR4 4
 #define MATRIX 16
+#define AFFINE 12
+#define DUALQUAT 8
 
 // Constant: version should be 0, id is the constant id, persistent should be 1
 
@@ -24,6 +28,18 @@ static float c_ident_quat[4] = {
 	0, 0, 0, 1,
 };
 
+static float c_ident_affine[12] = {
+	1,0,0,
+	0,1,0,
+	0,0,1,
+	0,0,0,
+};
+
+static float c_ident_dualquat[8] = {
+	0, 0, 0, 1,
+	0, 0, 0, 0,
+};
+
 struct constant {
 	float * ptr;
 	int size;
@@ -33,13 +49,19 @@ static struct constant c_constant_table[LINEAR_TYPE_COUNT] = {
 	{ c_ident_mat, MATRIX },
 	{ c_ident_vec, VECTOR4 },	
 	{ c_ident_quat, VECTOR4 },
+	{ c_ident_affine, AFFINE },
+	{ c_ident_dualquat, DUALQUAT },
 };
 
+// the type (and the number type LINEAR_TYPE_COUNT) is stored in LINEAR_TYPE_BITS_NUM bits
+typedef char check_type_bits[LINEAR_TYPE_COUNT < (1 << LINEAR_TYPE_BITS_NUM) ? 1 : -1];
+
 struct stackid_ {
 	uint32_t version:24;
 	uint32_t id:24;
-	uint32_t type : LINEAR_TYPE_BITS_NUM;	// 0:matrix 1:vector4 2:float 3:quaternion 4:euler
+	uint32_t type : LINEAR_TYPE_BITS_NUM;	// 0:matrix 1:vector4 2:quaternion 3:affine 4:dualquat
 	uint32_t persistent:1;	// 0: persisent 1: temp
+	uint32_t view:1;	// 1: element of a view, version is the view handle, id is the index
 };
 
 union stackid {
@@ -55,26 +77,61 @@ lastack_constant(int cons) {
 	sid.s.version = 0;
 	sid.s.id = cons;
 	sid.s.persistent = 1;
+	sid.s.view = 0;
 	sid.s.type = cons;
 	
 	return sid.i;
 }
 
+// view : external memory of values, see lastack_view_new
+
+#define VIEW_SLOT_BITS 16
+#define VIEW_SLOT_MASK ((1 << VIEW_SLOT_BITS) - 1)
+#define VIEW_SERIAL_MASK 0xff	// 24 bits version = 16 bits slot + 8 bits serial
+#define VIEW_MAXINDEX (1 << 24)
+#define VIEW_USED -2
+
+struct view_slot {
+	float *ptr;
+	int count;
+	int stride;
+	int type;
+	int serial;
+	int next;	// free list (-1 : the end), or VIEW_USED
+};
+
 struct lastack {
+	lastack_sampler sampler;
+	void *caller;
+	void *sampler_ud;
+	int sample_interval;
+	int sample_countdown;
 	int temp_vector_cap;
 	int temp_vector_top;
 	int temp_matrix_cap;
 	int temp_matrix_top;
+	int temp_affine_cap;
+	int temp_affine_top;
+	int temp_dualquat_cap;
+	int temp_dualquat_top;
 	int version;
 	int stack_cap;
 	int stack_top;
 	float * temp_vec;
 	float * temp_mat;
+	float * temp_aff;
+	float * temp_dq;
 	struct blob * per_vec;
 	struct blob * per_mat;
+	struct blob * per_aff;
+	struct blob * per_dq;
 	struct oldpage *old;
 	union stackid *stack;
 	size_t oldpage_size;
+	struct view_slot *view;
+	int view_cap;
+	int view_freelist;
+	int view_retired;	// slots of wrapped serial, reuse them after reset
 };
 
 #define TAG_FREE 0
@@ -149,6 +206,7 @@ free_oldpage(struct oldpage *p) {
 static int
 blob_alloc(struct blob *B, int version) {
 	if (SLOT_EMPTY(B->freeslot)) {
+		uint64_t trace_t = MATH3D_TRACE_BEGIN();
 		struct oldpage * p = malloc(sizeof(*p));
 		p->next = B->old;
 		p->page = B->buffer;
@@ -164,6 +222,7 @@ blob_alloc(struct blob *B, int version) {
 		static int alloc_count = 0;
 		alloc_count ++;
 		init_blob_slots(B, cap, B->cap);
+		MATH3D_TRACE_END("blob_grow", trace_t, B->cap);
 	}
 	int ret = SLOT_INDEX(B->freeslot);
 	struct slot *s = &B->s[ret];
@@ -276,16 +335,33 @@ lastack_new() {
 	LS->temp_vector_top = 0;
 	LS->temp_matrix_cap = MINCAP;
 	LS->temp_matrix_top = 0;
+	LS->temp_affine_cap = MINCAP;
+	LS->temp_affine_top = 0;
+	LS->temp_dualquat_cap = MINCAP;
+	LS->temp_dualquat_top = 0;
 	LS->version = 1;	// base 1
 	LS->stack_cap = MINCAP;
 	LS->stack_top = 0;
 	LS->temp_vec = malloc(LS->temp_vector_cap * VECTOR4 * sizeof(float));
 	LS->temp_mat = malloc(LS->temp_matrix_cap * MATRIX * sizeof(float));
+	LS->temp_aff = malloc(LS->temp_affine_cap * AFFINE * sizeof(float));
+	LS->temp_dq = malloc(LS->temp_dualquat_cap * DUALQUAT * sizeof(float));
 	LS->per_vec = blob_new(VECTOR4 * sizeof(float), MINCAP);
 	LS->per_mat = blob_new(MATRIX * sizeof(float), MINCAP);
+	LS->per_aff = blob_new(AFFINE * sizeof(float), MINCAP);
+	LS->per_dq = blob_new(DUALQUAT * sizeof(float), MINCAP);
 	LS->old = NULL;
 	LS->stack = malloc(LS->stack_cap * sizeof(*LS->stack));
 	LS->oldpage_size = 0;
+	LS->view = NULL;
+	LS->view_cap = 0;
+	LS->view_freelist = -1;
+	LS->view_retired = -1;
+	LS->caller = NULL;
+	LS->sampler = NULL;
+	LS->sampler_ud = NULL;
+	LS->sample_interval = 0;
+	LS->sample_countdown = INT_MAX;
 	return LS;
 }
 
@@ -294,21 +370,68 @@ lastack_size(struct lastack *LS) {
 	return sizeof(*LS)
 		+ LS->temp_vector_cap * VECTOR4 * sizeof(float)
 		+ LS->temp_matrix_cap * MATRIX * sizeof(float)
+		+ LS->temp_affine_cap * AFFINE * sizeof(float)
+		+ LS->temp_dualquat_cap * DUALQUAT * sizeof(float)
 		+ LS->stack_cap * sizeof(*LS->stack)
 		+ blob_size(LS->per_vec)
-		+ blob_size(LS->per_mat);
+		+ blob_size(LS->per_mat)
+		+ blob_size(LS->per_aff)
+		+ blob_size(LS->per_dq)
+		+ LS->view_cap * sizeof(*LS->view);
+}
+
+int
+lastack_temps(struct lastack *LS) {
+	return LS->temp_vector_top + LS->temp_matrix_top + LS->temp_affine_top + LS->temp_dualquat_top;
+}
+
+void
+lastack_sample(struct lastack *LS, lastack_sampler f, void *ud, int interval) {
+	if (interval < 1)
+		interval = 1;
+	LS->sampler = f;
+	LS->sampler_ud = ud;
+	LS->sample_interval = interval;
+	LS->sample_countdown = f ? interval : INT_MAX;
+	LS->caller = NULL;
+}
+
+// the caller is kept only while a sampler is installed
+int
+lastack_setcaller(struct lastack *LS, void *caller) {
+	if (LS->sampler == NULL || LS->caller == caller)
+		return 0;
+	LS->caller = caller;
+	return 1;
 }
 
+static void
+sample_temp(struct lastack *LS, int size) {
+	if (LS->sampler) {
+		LS->sample_countdown = LS->sample_interval;
+		LS->sampler(LS->sampler_ud, LS->caller, size);
+	} else {
+		LS->sample_countdown = INT_MAX;
+	}
+}
+
+#define SAMPLE_TEMP(LS, size) if (--(LS)->sample_countdown == 0) sample_temp(LS, size)
+
 void
 lastack_delete(struct lastack *LS) {
 	if (LS == NULL)
 		return;
 	free(LS->temp_vec);
 	free(LS->temp_mat);
+	free(LS->temp_aff);
+	free(LS->temp_dq);
 	blob_delete(LS->per_vec);
 	blob_delete(LS->per_mat);
+	blob_delete(LS->per_aff);
+	blob_delete(LS->per_dq);
 	free(LS->stack);
 	free_oldpage(LS->old);
+	free(LS->view);
 	free(LS);
 }
 
@@ -332,7 +455,7 @@ new_page(struct lastack *LS, void *page, size_t page_size) {
 
 int
 lastack_typesize(int type) {
-	const int sizes[LINEAR_TYPE_COUNT] = { 16, 4, 4 };
+	const int sizes[LINEAR_TYPE_COUNT] = { 16, 4, 4, 12, 8 };
 //	assert(LINEAR_TYPE_MAT <= type && type < LINEAR_TYPE_COUNT);
 	return sizes[type];
 }
@@ -343,6 +466,8 @@ lastack_typename(int t) {
 		"mat",
 		"v4",
 		"quat",
+		"affine",
+		"dualquat",
 	};
 	if (t < 0 || t >= sizeof(type_names)/sizeof(type_names[0]))
 		return "unknown";
@@ -352,12 +477,15 @@ lastack_typename(int t) {
 
 static float *
 check_matrix_pool(struct lastack *LS) {
+	SAMPLE_TEMP(LS, MATRIX * sizeof(float));
 	if (LS->temp_matrix_top >= LS->temp_matrix_cap) {
+		uint64_t trace_t = MATH3D_TRACE_BEGIN();
 		size_t sz = LS->temp_matrix_cap * sizeof(float) * MATRIX;
 		void * p = new_page(LS, LS->temp_mat, sz);
 		LS->temp_mat = malloc(sz * 2);
 		memcpy(LS->temp_mat, p, sz);
 		LS->temp_matrix_cap *= 2;
+		MATH3D_TRACE_END("matrix_pool_grow", trace_t, LS->temp_matrix_cap);
 	}
 	return LS->temp_mat + LS->temp_matrix_top * MATRIX;
 }
@@ -369,12 +497,59 @@ lastack_pushmatrix(struct lastack *LS, const float *mat) {
 	union stackid sid;
 	sid.s.type = LINEAR_TYPE_MAT;
 	sid.s.persistent = 0;
+	sid.s.view = 0;
 	sid.s.version = LS->version;
 	sid.s.id = LS->temp_matrix_top;
 	push_id(LS, sid);
 	++ LS->temp_matrix_top;
 }
 
+void
+lastack_pushaffine(struct lastack *LS, const float *m) {
+	SAMPLE_TEMP(LS, AFFINE * sizeof(float));
+	if (LS->temp_affine_top >= LS->temp_affine_cap) {
+		uint64_t trace_t = MATH3D_TRACE_BEGIN();
+		size_t sz = LS->temp_affine_cap * sizeof(float) * AFFINE;
+		void * p = new_page(LS, LS->temp_aff, sz);
+		LS->temp_aff = malloc(sz * 2);
+		memcpy(LS->temp_aff, p, sz);
+		LS->temp_affine_cap *= 2;
+		MATH3D_TRACE_END("affine_pool_grow", trace_t, LS->temp_affine_cap);
+	}
+	memcpy(LS->temp_aff + LS->temp_affine_top * AFFINE, m, sizeof(float) * AFFINE);
+	union stackid sid;
+	sid.s.type = LINEAR_TYPE_AFFINE;
+	sid.s.persistent = 0;
+	sid.s.view = 0;
+	sid.s.version = LS->version;
+	sid.s.id = LS->temp_affine_top;
+	push_id(LS, sid);
+	++ LS->temp_affine_top;
+}
+
+void
+lastack_pushdualquat(struct lastack *LS, const float *dq) {
+	SAMPLE_TEMP(LS, DUALQUAT * sizeof(float));
+	if (LS->temp_dualquat_top >= LS->temp_dualquat_cap) {
+		uint64_t trace_t = MATH3D_TRACE_BEGIN();
+		size_t sz = LS->temp_dualquat_cap * sizeof(float) * DUALQUAT;
+		void * p = new_page(LS, LS->temp_dq, sz);
+		LS->temp_dq = malloc(sz * 2);
+		memcpy(LS->temp_dq, p, sz);
+		LS->temp_dualquat_cap *= 2;
+		MATH3D_TRACE_END("dualquat_pool_grow", trace_t, LS->temp_dualquat_cap);
+	}
+	memcpy(LS->temp_dq + LS->temp_dualquat_top * DUALQUAT, dq, sizeof(float) * DUALQUAT);
+	union stackid sid;
+	sid.s.type = LINEAR_TYPE_DUALQUAT;
+	sid.s.persistent = 0;
+	sid.s.view = 0;
+	sid.s.version = LS->version;
+	sid.s.id = LS->temp_dualquat_top;
+	push_id(LS, sid);
+	++ LS->temp_dualquat_top;
+}
+
 void
 lastack_pushsrt(struct lastack *LS, const float *s, const float *r, const float *t) {
 #define NOTIDENTITY (~0)
@@ -439,6 +614,7 @@ lastack_pushsrt(struct lastack *LS, const float *s, const float *r, const float
 	union stackid sid;
 	sid.s.type = LINEAR_TYPE_MAT;
 	sid.s.persistent = 0;
+	sid.s.view = 0;
 	sid.s.version = LS->version;
 	sid.s.id = LS->temp_matrix_top;
 	push_id(LS, sid);
@@ -450,20 +626,30 @@ lastack_pushobject(struct lastack *LS, const float *v, int type) {
 	if (type == LINEAR_TYPE_MAT) {
 		lastack_pushmatrix(LS, v);
 		return;
+	} else if (type == LINEAR_TYPE_AFFINE) {
+		lastack_pushaffine(LS, v);
+		return;
+	} else if (type == LINEAR_TYPE_DUALQUAT) {
+		lastack_pushdualquat(LS, v);
+		return;
 	}
 	assert(type >= LINEAR_TYPE_VEC4 && type <= LINEAR_TYPE_QUAT);
 	const int size = lastack_typesize(type);
+	SAMPLE_TEMP(LS, VECTOR4 * sizeof(float));
 	if (LS->temp_vector_top >= LS->temp_vector_cap) {
+		uint64_t trace_t = MATH3D_TRACE_BEGIN();
 		size_t sz = LS->temp_vector_cap * sizeof(float) * VECTOR4;
 		void * p = new_page(LS, LS->temp_vec, sz);
 		LS->temp_vec = malloc(sz * 2);
 		memcpy(LS->temp_vec, p, sz);
 		LS->temp_vector_cap *= 2;
+		MATH3D_TRACE_END("vector_pool_grow", trace_t, LS->temp_vector_cap);
 	}
 	memcpy(LS->temp_vec + LS->temp_vector_top * VECTOR4, v, sizeof(float) * size);
 	union stackid sid;
 	sid.s.type = type;
 	sid.s.persistent = 0;
+	sid.s.view = 0;
 	sid.s.version = LS->version;
 	sid.s.id = LS->temp_vector_top;
 	push_id(LS, sid);
@@ -480,6 +666,112 @@ lastack_pushquat(struct lastack *LS, const float *v) {
 	lastack_pushobject(LS, v, LINEAR_TYPE_QUAT);
 }
 
+static inline struct view_slot *
+view_slot(struct lastack *LS, int handle) {
+	int slot = handle & VIEW_SLOT_MASK;
+	if (slot >= LS->view_cap)
+		return NULL;
+	struct view_slot *v = &LS->view[slot];
+	if (v->next != VIEW_USED || v->serial != (handle >> VIEW_SLOT_BITS))
+		return NULL;
+	return v;
+}
+
+int
+lastack_view_new(struct lastack *LS, float *ptr, int count, int stride, int type) {
+	if (type < 0 || type >= LINEAR_TYPE_COUNT || count < 0 || count > VIEW_MAXINDEX || stride < lastack_typesize(type))
+		return -1;
+	if (LS->view_freelist < 0) {
+		int cap = LS->view_cap;
+		if (cap > VIEW_SLOT_MASK)
+			return -1;
+		LS->view_cap = cap == 0 ? MINCAP : cap * 2;
+		if (LS->view_cap > VIEW_SLOT_MASK + 1)
+			LS->view_cap = VIEW_SLOT_MASK + 1;
+		LS->view = realloc(LS->view, LS->view_cap * sizeof(*LS->view));
+		int i;
+		for (i=cap;i<LS->view_cap;i++) {
+			LS->view[i].serial = 0;
+			LS->view[i].next = i + 1 < LS->view_cap ? i + 1 : -1;
+		}
+		LS->view_freelist = cap;
+	}
+	int slot = LS->view_freelist;
+	struct view_slot *v = &LS->view[slot];
+	LS->view_freelist = v->next;
+	v->ptr = ptr;
+	v->count = count;
+	v->stride = stride;
+	v->type = type;
+	v->next = VIEW_USED;
+	return slot | (v->serial << VIEW_SLOT_BITS);
+}
+
+void
+lastack_view_delete(struct lastack *LS, int handle) {
+	struct view_slot *v = view_slot(LS, handle);
+	if (v == NULL)
+		return;
+	v->serial = (v->serial + 1) & VIEW_SERIAL_MASK;
+	if (v->serial == 0) {
+		// the stale ids of this slot would be valid again, retire it until lastack_reset
+		v->next = LS->view_retired;
+		LS->view_retired = handle & VIEW_SLOT_MASK;
+	} else {
+		v->next = LS->view_freelist;
+		LS->view_freelist = handle & VIEW_SLOT_MASK;
+	}
+}
+
+static void
+view_reclaim(struct lastack *LS) {
+	while (LS->view_retired >= 0) {
+		int slot = LS->view_retired;
+		struct view_slot *v = &LS->view[slot];
+		LS->view_retired = v->next;
+		v->next = LS->view_freelist;
+		LS->view_freelist = slot;
+	}
+}
+
+int64_t
+lastack_viewid(struct lastack *LS, int handle, int index) {
+	struct view_slot *v = view_slot(LS, handle);
+	if (v == NULL || index < 0 || index >= v->count)
+		return 0;
+	union stackid sid;
+	sid.s.version = handle;
+	sid.s.id = index;
+	sid.s.type = v->type;
+	sid.s.persistent = 0;
+	sid.s.view = 1;
+	return sid.i;
+}
+
+float *
+lastack_view_address(struct lastack *LS, int handle, int index) {
+	struct view_slot *v = view_slot(LS, handle);
+	if (v == NULL || index < 0 || index >= v->count)
+		return NULL;
+	return v->ptr + (size_t)index * v->stride;
+}
+
+int
+lastack_isview(int64_t id) {
+	union stackid sid;
+	sid.i = id;
+	return sid.s.view;
+}
+
+static inline struct blob *
+persistent_blob(struct lastack *LS, int type) {
+	if (type == LINEAR_TYPE_AFFINE)
+		return LS->per_aff;
+	if (type == LINEAR_TYPE_DUALQUAT)
+		return LS->per_dq;
+	return lastack_typesize(type) == MATRIX ? LS->per_mat : LS->per_vec;
+}
+
 const float *
 lastack_value(struct lastack *LS, int64_t ref, int *type) {
 	union stackid sid;
@@ -489,6 +781,9 @@ lastack_value(struct lastack *LS, int64_t ref, int *type) {
 	void * address = NULL;
 	if (type)
 		*type = sid.s.type;
+	if (sid.s.view) {
+		return lastack_view_address(LS, ver, id);
+	}
 	if (sid.s.persistent) {
 		if (sid.s.version == 0) {
 			// constant
@@ -498,18 +793,24 @@ lastack_value(struct lastack *LS, int64_t ref, int *type) {
 			struct constant * c = &c_constant_table[id];
 			return c->ptr;
 		}
-		if (lastack_typesize(sid.s.type) == MATRIX) {
-			address = blob_address( LS->per_mat , id, ver);
-		} else {
-			address = blob_address( LS->per_vec , id, ver);
-		}
+		address = blob_address( persistent_blob(LS, sid.s.type) , id, ver);
 		return address;
 	} else {
 		if (ver != LS->version) {
 			// version expired
 			return NULL;
 		}
-		if (lastack_typesize(sid.s.type) == MATRIX) {
+		if (sid.s.type == LINEAR_TYPE_AFFINE) {
+			if (id >= LS->temp_affine_top) {
+				return NULL;
+			}
+			return LS->temp_aff + id * AFFINE;
+		} else if (sid.s.type == LINEAR_TYPE_DUALQUAT) {
+			if (id >= LS->temp_dualquat_top) {
+				return NULL;
+			}
+			return LS->temp_dq + id * DUALQUAT;
+		} else if (lastack_typesize(sid.s.type) == MATRIX) {
 			if (id >= LS->temp_matrix_top) {
 				return NULL;
 			}
@@ -540,11 +841,7 @@ lastack_unmark(struct lastack *LS, int64_t markid) {
 	union stackid id;
 	id.i = markid;
 	if (id.s.persistent && id.s.version != 0) {
-		if (lastack_typesize(id.s.type) != MATRIX) {
-			blob_dealloc(LS->per_vec, id.s.id, id.s.version);
-		} else {
-			blob_dealloc(LS->per_mat, id.s.id, id.s.version);
-		}
+		blob_dealloc(persistent_blob(LS, id.s.type), id.s.id, id.s.version);
 	}
 }
 
@@ -569,21 +866,17 @@ lastack_mark(struct lastack *LS, int64_t tempid) {
 	union stackid sid;
 	sid.s.version = LS->version;
 	sid.s.type = t;
-	if (lastack_typesize(t) != MATRIX) {
-		id = blob_alloc(LS->per_vec, LS->version);
-		void * dest = blob_address(LS->per_vec, id, LS->version);
-		memcpy(dest, address, sizeof(float) * VECTOR4);
-	} else {
-		id = blob_alloc(LS->per_mat, LS->version);
-		void * dest = blob_address(LS->per_mat, id, LS->version);
-		memcpy(dest, address, sizeof(float) * MATRIX);
-	}
+	struct blob *B = persistent_blob(LS, t);
+	id = blob_alloc(B, LS->version);
+	void * dest = blob_address(B, id, LS->version);
+	memcpy(dest, address, sizeof(float) * lastack_typesize(t));
 	sid.s.id = id;
 	if (sid.s.id != id) {
 		//printf(" --- s.id(%d) != id(%d) --- \n ",sid.s.id,id);
 		return 0;
 	}
 	sid.s.persistent = 1;
+	sid.s.view = 0;
 	return sid.i;
 }
 
@@ -643,6 +936,7 @@ lastack_swap(struct lastack *LS) {
 
 void
 lastack_reset(struct lastack *LS) {
+	MATH3D_TRACE_MARK("reset", lastack_temps(LS));
 	union stackid v;
 	v.s.version = LS->version + 1;
 	if (v.s.version == 0)
@@ -654,8 +948,13 @@ lastack_reset(struct lastack *LS) {
 	LS->oldpage_size = 0;
 	blob_flush(LS->per_vec);
 	blob_flush(LS->per_mat);
+	blob_flush(LS->per_aff);
+	blob_flush(LS->per_dq);
 	LS->temp_vector_top = 0;
 	LS->temp_matrix_top = 0;
+	LS->temp_affine_top = 0;
+	LS->temp_dualquat_top = 0;
+	view_reclaim(LS);
 }
 
 static void
@@ -685,6 +984,14 @@ print_object(const float *address, int id, int type) {
 		printf("(Q%d: ",id);
 		print_float(address, 4);
 		break;
+	case LINEAR_TYPE_AFFINE:
+		printf("(A%d: ",id);
+		print_float(address, 12);
+		break;
+	case LINEAR_TYPE_DUALQUAT:
+		printf("(D%d: ",id);
+		print_float(address, 8);
+		break;
 	default:
 		printf("(Invalid");
 		break;
@@ -712,6 +1019,10 @@ lastack_print(struct lastack *LS) {
 	blob_print(LS->per_vec);
 	printf("Persistent Matrix ");
 	blob_print(LS->per_mat);
+	printf("Persistent Affine ");
+	blob_print(LS->per_aff);
+	printf("Persistent Dualquat ");
+	blob_print(LS->per_dq);
 }
 
 int
@@ -762,12 +1073,20 @@ lastack_idstring(int64_t id, char tmp[64]) {
 	case LINEAR_TYPE_QUAT:
 		flags[0] = 'Q';
 		break;
+	case LINEAR_TYPE_AFFINE:
+		flags[0] = 'A';
+		break;
+	case LINEAR_TYPE_DUALQUAT:
+		flags[0] = 'D';
+		break;
 	default:
 		flags[0] = '?';
 		break;
 	}
 	if (sid.s.persistent) {
 		flags[1] = 'P';
+	} else if (sid.s.view) {
+		flags[1] = 'W';
 	}
 	snprintf(tmp, 64, "id=%d version=%d %s",sid.s.id, sid.s.version, flags);
 	return tmp;
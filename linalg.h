@@ -9,13 +9,18 @@ enum LinearType {
 	LINEAR_TYPE_MAT = 0,
 	LINEAR_TYPE_VEC4,	
 	LINEAR_TYPE_QUAT,
+	LINEAR_TYPE_AFFINE,	// 3x4 : 4 columns of vec3, the last row is always 0,0,0,1
+	LINEAR_TYPE_DUALQUAT,	// 2 quats : real (rotation), dual (translation)
 	LINEAR_TYPE_COUNT,
 };
 
-#define	LINEAR_TYPE_BITS_NUM 3
+#define	LINEAR_TYPE_BITS_NUM 3	// LINEAR_TYPE_COUNT (the number type in math3dfunc.h) should fit in it
 
 struct lastack;
 
+// sampler(ud, caller, size) is called every interval temp values pushed, size in bytes
+typedef void (*lastack_sampler)(void *ud, void *caller, int size);
+
 int64_t lastack_constant(int cons);
 int lastack_isconstant(int64_t id);
 int lastack_marked(int64_t id, int *type);
@@ -30,6 +35,8 @@ void lastack_pushobject(struct lastack *LS, const float *v, int type);
 void lastack_pushvec4(struct lastack *LS, const float *v);
 void lastack_pushquat(struct lastack *LS, const float *v);
 void lastack_pushmatrix(struct lastack *LS, const float *mat);
+void lastack_pushaffine(struct lastack *LS, const float *m);
+void lastack_pushdualquat(struct lastack *LS, const float *dq);
 void lastack_pushsrt(struct lastack *LS, const float *s, const float *r, const float *t);
 const float * lastack_value(struct lastack *LS, int64_t id, int *type);
 int lastack_pushref(struct lastack *LS, int64_t id);
@@ -45,6 +52,16 @@ int lastack_gettop(struct lastack *LS); // for debug, get stack length
 void lastack_dump(struct lastack *LS, int from); // for debug, dump top values
 int lastack_type(struct lastack *LS, int64_t id);
 size_t lastack_size(struct lastack *LS);
+int lastack_temps(struct lastack *LS);	// number of temp values since last reset
+void lastack_sample(struct lastack *LS, lastack_sampler f, void *ud, int interval);	// f = NULL to stop
+int lastack_setcaller(struct lastack *LS, void *caller);	// the caller passed to the sampler, returns 1 if it's changed
+
+// view : count values at ptr, stride in floats. returns a handle, -1 if failed
+int lastack_view_new(struct lastack *LS, float *ptr, int count, int stride, int type);
+void lastack_view_delete(struct lastack *LS, int handle);	// stale ids of the handle resolve to NULL until lastack_reset at least
+int64_t lastack_viewid(struct lastack *LS, int handle, int index);	// 0 if invalid
+float * lastack_view_address(struct lastack *LS, int handle, int index);	// NULL if invalid
+int lastack_isview(int64_t id);
 
 static inline int lastack_is_vec_type(int type) {
 	return (type == LINEAR_TYPE_VEC4) ? 1 : 0;
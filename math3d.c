@@ -4,6 +4,7 @@
 #include <lauxlib.h>
 #include <math.h>
 #include <float.h>
+#include <stdlib.h>
 
 #ifndef _MSC_VER
 #ifndef M_PI
@@ -21,11 +22,13 @@
 #include "linalg.h"	
 #include "math3d.h"
 #include "math3dfunc.h"
+#include "trace.h"
 
 #define MAT_PERSPECTIVE 0
 #define MAT_ORTHO 1
 
 static int g_default_homogeneous_depth = 0;
+static int g_default_fast_math = 0;
 
 int
 math3d_homogeneous_depth() {
@@ -37,11 +40,6 @@ STACKID(int64_t id) {
 	return (void *)id;
 }
 
-static inline void *
-REFID(struct refobject *R) {
-	return STACKID(R->id);
-}
-
 static inline int64_t
 LUAID(lua_State *L, int index) {
 	luaL_checktype(L, index, LUA_TLIGHTUSERDATA);
@@ -51,7 +49,9 @@ LUAID(lua_State *L, int index) {
 
 static inline struct lastack *
 GETLS(lua_State *L) {
-	return (struct lastack *)lua_touserdata(L, lua_upvalueindex(1));
+	struct lastack *LS = (struct lastack *)lua_touserdata(L, lua_upvalueindex(1));
+	math3d_setcaller(L, LS);
+	return LS;
 }
 
 static void
@@ -89,7 +89,7 @@ get_id(lua_State *L, int index, int ltype) {
 static int
 lref(lua_State *L) {
 	lua_settop(L, 1);
-	struct refobject * R = lua_newuserdatauv(L, sizeof(struct refobject), 0);
+	struct refobject * R = lua_newuserdatauv(L, sizeof(struct refobject), 1);
 	if (lua_isnil(L, 1)) {
 		R->id = 0;
 	} else {
@@ -120,6 +120,22 @@ assign_id(lua_State *L, struct lastack *LS, int index, int mtype, int ltype) {
 			} else if (mtype == LINEAR_TYPE_QUAT && type == LINEAR_TYPE_MAT) {
 				math3d_matrix_to_quat(LS, v);
 				id = lastack_pop(LS);
+			} else if (mtype == LINEAR_TYPE_MAT && type == LINEAR_TYPE_AFFINE) {
+				float m[16];
+				math3d_affine_to_matrix(v, m);
+				lastack_pushmatrix(LS, m);
+				id = lastack_pop(LS);
+			} else if (mtype == LINEAR_TYPE_AFFINE && type == LINEAR_TYPE_MAT) {
+				float a[12];
+				math3d_matrix_to_affine(v, a);
+				lastack_pushaffine(LS, a);
+				id = lastack_pop(LS);
+			} else if (mtype == LINEAR_TYPE_MAT && type == LINEAR_TYPE_DUALQUAT) {
+				math3d_dualquat_to_matrix(LS, v);
+				id = lastack_pop(LS);
+			} else if (mtype == LINEAR_TYPE_DUALQUAT && type == LINEAR_TYPE_MAT) {
+				math3d_matrix_to_dualquat(LS, v);
+				id = lastack_pop(LS);
 			} else {
 				return luaL_error(L, "%s type mismatch %s", lastack_typename(mtype), lastack_typename(type));
 			}
@@ -144,6 +160,38 @@ unpack_numbers(lua_State *L, int index, float *v, int n) {
 
 typedef int64_t (*from_table_func)(lua_State *L, struct lastack *LS, int index);
 
+// binary string : little-endian floats
+
+static inline void
+decode_floats(const char *s, float *v, int n) {
+	int i;
+	for (i=0;i<n;i++) {
+		const unsigned char *b = (const unsigned char *)s + i * 4;
+		uint32_t u = b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+		memcpy(&v[i], &u, sizeof(float));
+	}
+}
+
+// string at index, with an optional 1-based byte offset at index+1
+static const char *
+binary_source(lua_State *L, int index, size_t sz) {
+	size_t len;
+	const char *s = lua_tolstring(L, index, &len);
+	lua_Integer offset = luaL_optinteger(L, index+1, 1);
+	if (offset < 1 || (size_t)(offset - 1) + sz > len)
+		luaL_error(L, "Invalid binary string (size = %d, offset = %d, need %d bytes)", (int)len, (int)offset, (int)sz);
+	return s + offset - 1;
+}
+
+static int64_t
+object_from_string(lua_State *L, struct lastack *LS, int index, int type) {
+	const int n = lastack_typesize(type);
+	float v[16];
+	decode_floats(binary_source(L, index, n * sizeof(float)), v, n);
+	lastack_pushobject(LS, v, type);
+	return lastack_pop(LS);
+}
+
 static int64_t
 vector_from_table(lua_State *L, struct lastack *LS, int index) {
 	int n = lua_rawlen(L, index);
@@ -169,7 +217,16 @@ object_from_index(lua_State *L, struct lastack *LS, int index, int mtype, from_t
 		int64_t id = get_id(L, index, ltype);
 		int type;
 		result = lastack_value(LS, id, &type);
-		if (result == NULL || type != mtype) {
+		if (result && type == LINEAR_TYPE_AFFINE && mtype == LINEAR_TYPE_MAT) {
+			// an affine matrix can be used as a matrix
+			float m[16];
+			math3d_affine_to_matrix(result, m);
+			lastack_pushmatrix(LS, m);
+			result = lastack_value(LS, lastack_pop(LS), NULL);
+		} else if (result && type == LINEAR_TYPE_DUALQUAT && mtype == LINEAR_TYPE_MAT) {
+			math3d_dualquat_to_matrix(LS, result);
+			result = lastack_value(LS, lastack_pop(LS), NULL);
+		} else if (result == NULL || type != mtype) {
 			luaL_error(L, "Need a %s , it's a %s.", lastack_typename(mtype), result == NULL ? "invalid" : lastack_typename(type));
 		}
 		break; }
@@ -260,12 +317,51 @@ matrix_from_table(lua_State *L, struct lastack *LS, int index) {
 	return lastack_pop(LS);
 }
 
+// srt table, 12 numbers (4 columns of vec3) or 16 numbers (matrix)
+static int64_t
+affine_from_table(lua_State *L, struct lastack *LS, int index) {
+	int n = lua_rawlen(L, index);
+	float v[16];
+	if (n == 12) {
+		unpack_numbers(L, index, v, 12);
+	} else if (n == 0 || n == 16) {
+		const float *m = lastack_value(LS, matrix_from_table(L, LS, index), NULL);
+		math3d_matrix_to_affine(m, v);
+	} else {
+		return luaL_error(L, "Affine need a array of 12 (%d)", n);
+	}
+	lastack_pushaffine(LS, v);
+	return lastack_pop(LS);
+}
+
+// { r = quat, t = vector } (s is ignored), 8 numbers (real, dual) or 16 numbers (matrix)
+static int64_t
+dualquat_from_table(lua_State *L, struct lastack *LS, int index) {
+	int n = lua_rawlen(L, index);
+	if (n == 8) {
+		float v[8];
+		unpack_numbers(L, index, v, 8);
+		lastack_pushdualquat(LS, v);
+	} else if (n == 16) {
+		math3d_matrix_to_dualquat(LS, lastack_value(LS, matrix_from_table(L, LS, index), NULL));
+	} else if (n == 0) {
+		const float *q = object_from_field(L, LS, index, "r", LINEAR_TYPE_QUAT, quat_from_table);
+		const float *t = object_from_field(L, LS, index, "t", LINEAR_TYPE_VEC4, vector_from_table);
+		math3d_make_dualquat(LS, q, t);
+	} else {
+		return luaL_error(L, "Dualquat need a array of 8 (%d)", n);
+	}
+	return lastack_pop(LS);
+}
+
 static int64_t
 assign_object(lua_State *L, struct lastack *LS, int index, int mtype, from_table_func from_table) {
 	int ltype = lua_type(L, index);
 	if (ltype == LUA_TTABLE) {
 		int64_t id = from_table(L, LS, index);
 		return lastack_mark(LS, id);
+	} else if (ltype == LUA_TSTRING) {
+		return lastack_mark(LS, object_from_string(L, LS, index, mtype));
 	}
 	return assign_id(L, LS, index, mtype, ltype);
 }
@@ -285,15 +381,51 @@ assign_quat(lua_State *L, struct lastack *LS, int index) {
 	return assign_object(L, LS, index, LINEAR_TYPE_QUAT, quat_from_table);
 }
 
+static int64_t
+assign_affine(lua_State *L, struct lastack *LS, int index) {
+	return assign_object(L, LS, index, LINEAR_TYPE_AFFINE, affine_from_table);
+}
+
+static int64_t
+assign_dualquat(lua_State *L, struct lastack *LS, int index) {
+	return assign_object(L, LS, index, LINEAR_TYPE_DUALQUAT, dualquat_from_table);
+}
+
 static inline void
-copy_matrix(lua_State *L, struct lastack *LS, int64_t id, float result[64]) {
+copy_matrix(lua_State *L, struct lastack *LS, int64_t id, float result[16]) {
 	int type;
 	const float *mat = lastack_value(LS, id, &type);
+	if (mat && type == LINEAR_TYPE_AFFINE) {
+		math3d_affine_to_matrix(mat, result);
+		return;
+	} else if (mat && type == LINEAR_TYPE_DUALQUAT) {
+		math3d_dualquat_to_matrix(LS, mat);
+		mat = lastack_value(LS, lastack_pop(LS), &type);
+	}
 	if (mat == NULL || type != LINEAR_TYPE_MAT)
 		luaL_error(L, "Need a matrix to decompose, it's a %s.", mat == NULL ? "None" : lastack_typename(type));
 	memcpy(result, mat, 16 * sizeof(float));
 }
 
+// mark the matrix on the top of stack, as the type of the old value oid (matrix, affine or dualquat)
+static int64_t
+mark_matrix_as(struct lastack *LS, int64_t oid) {
+	int64_t id = lastack_pop(LS);
+	switch (lastack_type(LS, oid)) {
+	case LINEAR_TYPE_AFFINE: {
+		float a[12];
+		math3d_matrix_to_affine(lastack_value(LS, id, NULL), a);
+		lastack_pushaffine(LS, a);
+		id = lastack_pop(LS);
+		break; }
+	case LINEAR_TYPE_DUALQUAT:
+		math3d_matrix_to_dualquat(LS, lastack_value(LS, id, NULL));
+		id = lastack_pop(LS);
+		break;
+	}
+	return lastack_mark(LS, id);
+}
+
 static int64_t
 assign_scale(lua_State *L, struct lastack *LS, int index, int64_t oid) {
 	float mat[64];
@@ -314,7 +446,7 @@ assign_scale(lua_State *L, struct lastack *LS, int index, int64_t oid) {
 	float *trans = &mat[3*4];
 	math3d_decompose_rot(mat, quat);
 	math3d_make_srt(LS, scale, quat, trans);
-	return lastack_mark(LS, lastack_pop(LS));
+	return mark_matrix_as(LS, oid);
 }
 
 static int64_t
@@ -326,7 +458,7 @@ assign_rot(lua_State *L, struct lastack *LS, int index, int64_t oid) {
 	float *trans = &mat[3*4];
 	const float * quat = object_from_index(L, LS, index, LINEAR_TYPE_QUAT, quat_from_table);
 	math3d_make_srt(LS, scale, quat, trans);
-	return lastack_mark(LS, lastack_pop(LS));
+	return mark_matrix_as(LS, oid);
 }
 
 static int64_t
@@ -346,47 +478,139 @@ assign_trans(lua_State *L, struct lastack *LS, int index, int64_t oid) {
 		mat[3*4+3] = 1;
 	}
 	lastack_pushmatrix(LS, mat);
-	return lastack_mark(LS, lastack_pop(LS));
+	return mark_matrix_as(LS, oid);
 }
 
-static int
-lref_setter(lua_State *L) {
-	struct refobject *R = lua_touserdata(L, 1);
-	const char *key = luaL_checkstring(L, 2);
-	struct lastack *LS = GETLS(L);
-	int64_t oid = R->id;
+// returns the new marked id of the value at index, the old id (oid) is not unmarked
+static int64_t
+ref_assign(lua_State *L, struct lastack *LS, const char *key, int index, int64_t oid) {
 	switch(key[0]) {
 	case 'i':	// value id
-		R->id = lastack_mark(LS, get_id(L, 3, lua_type(L, 3)));
-		break;
+		return lastack_mark(LS, get_id(L, index, lua_type(L, index)));
 	case 'v':	// should be vector
-		R->id = assign_vector(L, LS, 3);
-		break;
+		return assign_vector(L, LS, index);
 	case 'q':	// should be quat
-		R->id = assign_quat(L, LS, 3);
-		break;
+		return assign_quat(L, LS, index);
 	case 'm':	// should be matrix
-		R->id = assign_matrix(L, LS, 3);
-		break;
+		return assign_matrix(L, LS, index);
+	case 'a':	// should be affine
+		return assign_affine(L, LS, index);
+	case 'd':	// should be dualquat
+		return assign_dualquat(L, LS, index);
+	case 's':
+		return assign_scale(L, LS, index, oid);
+	case 'r':
+		return assign_rot(L, LS, index, oid);
+	case 't':
+		return assign_trans(L, LS, index, oid);
+	default:
+		return luaL_error(L, "Invalid set key %s with ref object", key); 
+	}
+}
+
+// the srt cache of a ref, it's the user value of the ref, created at the first s/r/t access
+struct ref_srt {
+	int64_t id;	// srt is the decomposition of id
+	float srt[12];	// scale, rotation (quat), translation
+};
+
+// returns NULL if the ref at index (absolute) has no cache and create is 0
+static struct ref_srt *
+ref_srtcache(lua_State *L, int index, int create) {
+	struct ref_srt *C = NULL;
+	if (lua_getiuservalue(L, index, 1) == LUA_TUSERDATA) {
+		C = (struct ref_srt *)lua_touserdata(L, -1);
+	} else if (create) {
+		C = (struct ref_srt *)lua_newuserdatauv(L, sizeof(*C), 0);
+		C->id = 0;
+		lua_setiuservalue(L, index, 1);
+	}
+	lua_pop(L, 1);
+	return C;
+}
+
+// scale, rotation and translation of the matrix in ref (at index), decomposed once for each new id
+static struct ref_srt *
+ref_srt(lua_State *L, struct lastack *LS, struct refobject *R, int index) {
+	struct ref_srt *C = ref_srtcache(L, index, 1);
+	if (C->id != R->id || R->id == 0) {
+		float mat[16];
+		copy_matrix(L, LS, R->id, mat);
+		math3d_decompose_matrix_array(mat, 1, &C->srt[0], &C->srt[4], &C->srt[8]);
+		C->id = R->id;
+	}
+	return C;
+}
+
+// ref (at 1).s/r/t = value : rebuild the matrix from the cached components
+static int64_t
+ref_assign_srt(lua_State *L, struct lastack *LS, struct refobject *R, int what, int index) {
+	if (what == 't') {
+		// only replace the translation of the matrix, no need to decompose
+		struct ref_srt *C = ref_srtcache(L, 1, 0);
+		const int cached = C && C->id == R->id && R->id != 0;
+		int64_t id = assign_trans(L, LS, index, R->id);
+		if (cached) {
+			int type;
+			const float *m = lastack_value(LS, id, &type);
+			if (type == LINEAR_TYPE_AFFINE) {
+				memcpy(&C->srt[8], m + 3*3, 3 * sizeof(float));
+				C->srt[11] = 1;
+				C->id = id;
+			} else if (type == LINEAR_TYPE_MAT) {
+				memcpy(&C->srt[8], m + 3*4, 4 * sizeof(float));
+				C->id = id;
+			}	// dualquat : decompose again
+		}
+		return id;
+	}
+	struct ref_srt *C = ref_srt(L, LS, R, 1);
+	float *srt = C->srt;
+	switch (what) {
 	case 's':
-		R->id = assign_scale(L, LS, 3, oid);
+		if (lua_type(L, index) == LUA_TNUMBER) {
+			srt[0] = srt[1] = srt[2] = lua_tonumber(L, index);
+		} else {
+			const float *scale = object_from_index(L, LS, index, LINEAR_TYPE_VEC4, vector_from_table);
+			srt[0] = scale[0];
+			srt[1] = scale[1];
+			srt[2] = scale[2];
+		}
+		srt[3] = 0;
 		break;
 	case 'r':
-		R->id = assign_rot(L, LS, 3, oid);
+		memcpy(&srt[4], object_from_index(L, LS, index, LINEAR_TYPE_QUAT, quat_from_table), 4 * sizeof(float));
 		break;
+	}
+	math3d_make_srt(LS, &srt[0], &srt[4], &srt[8]);
+	C->id = mark_matrix_as(LS, R->id);
+	return C->id;
+}
+
+static int
+lref_setter(lua_State *L) {
+	struct refobject *R = lua_touserdata(L, 1);
+	const char *key = luaL_checkstring(L, 2);
+	struct lastack *LS = GETLS(L);
+	int64_t oid = R->id;
+	switch (key[0]) {
+	case 's':
+	case 'r':
 	case 't':
-		R->id = assign_trans(L, LS, 3, oid);
+		R->id = ref_assign_srt(L, LS, R, key[0], 3);
 		break;
 	default:
-		return luaL_error(L, "Invalid set key %s with ref object", key); 
+		R->id = ref_assign(L, LS, key, 3, oid);
+		break;
 	}
 	// we must unmark old id after assign, because 'v.i = v'
 	lastack_unmark(LS, oid);
 	return 0;
 }
 
+// dest is the index of a table to fill in place, 0 for a new table
 static void
-to_table(lua_State *L, struct lastack *LS, int64_t id) {
+to_table(lua_State *L, struct lastack *LS, int64_t id, int dest) {
 	int type;
 	const float * v = lastack_value(LS, id, &type);
 	if (v == NULL) {
@@ -395,7 +619,15 @@ to_table(lua_State *L, struct lastack *LS, int64_t id) {
 	}
 	int n = lastack_typesize(type);
 	int i;
-	lua_createtable(L, n, 1);
+	if (dest) {
+		lua_pushvalue(L, dest);
+		for (i=(int)lua_rawlen(L, -1);i>n;i--) {
+			lua_pushnil(L);
+			lua_rawseti(L, -2, i);
+		}
+	} else {
+		lua_createtable(L, n, 1);
+	}
 	for (i=0;i<n;i++) {
 		lua_pushnumber(L, v[i]);
 		lua_rawseti(L, -2, i+1);
@@ -430,27 +662,22 @@ extract_srt(struct lastack *LS, const float *mat, int what) {
 }
 
 static int
-ref_get_key(lua_State *L) {
-	struct refobject *R = lua_touserdata(L, 1);
-	struct lastack * LS = GETLS(L);
-	const char *key = lua_tostring(L, 2);
+ref_get_key(lua_State *L, struct lastack *LS, int64_t id, const char *key) {
 	switch(key[0]) {
 	case 'i':
-		lua_pushlightuserdata(L, REFID(R));
+		lua_pushlightuserdata(L, STACKID(id));
 		break;
 	case 'p':
-		lua_pushlightuserdata(L, (void *)(lastack_value(LS, R->id, NULL)));
+		lua_pushlightuserdata(L, (void *)(lastack_value(LS, id, NULL)));
 		break;
 	case 'v':
-		to_table(L, LS, R->id);
+		to_table(L, LS, id, 0);
 		break;
 	case 's':
 	case 'r':
 	case 't': {
-		int type;
-		const float *m = lastack_value(LS, R->id, &type);
-		if (m == NULL || type != LINEAR_TYPE_MAT)
-			return luaL_error(L, "Not a matrix");
+		float m[16];
+		copy_matrix(L, LS, id, m);
 		lua_pushlightuserdata(L, STACKID(extract_srt(LS, m ,key[0])));
 		break; }
 	default:
@@ -475,6 +702,19 @@ index_object(lua_State *L, struct lastack *LS, int64_t id, int idx) {
 		lastack_pushvec4(LS, &v[idx*4]);
 		lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
 		break;
+	case LINEAR_TYPE_AFFINE: {
+		// the column of the matrix
+		float c[4] = { v[idx*3], v[idx*3+1], v[idx*3+2], idx == 3 ? 1.0f : 0.0f };
+		lastack_pushvec4(LS, c);
+		lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+		break; }
+	case LINEAR_TYPE_DUALQUAT:
+		// 1 : real part, 2 : dual part
+		if (idx > 1)
+			return luaL_error(L, "Invalid dualquat index %d", idx+1);
+		lastack_pushquat(LS, &v[idx*4]);
+		lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+		break;
 	case LINEAR_TYPE_VEC4:
 		lua_pushnumber(L, v[idx]);
 		break;
@@ -515,8 +755,25 @@ lref_getter(lua_State *L) {
 	switch (type) {
 	case LUA_TNUMBER:
 		return ref_get_number(L);
-	case LUA_TSTRING:
-		return ref_get_key(L);
+	case LUA_TSTRING: {
+		struct refobject *R = lua_touserdata(L, 1);
+		struct lastack *LS = GETLS(L);
+		const char *key = lua_tostring(L, 2);
+		switch (key[0]) {
+		case 's':
+			lastack_pushvec4(LS, &ref_srt(L, LS, R, 1)->srt[0]);
+			break;
+		case 'r':
+			lastack_pushquat(LS, &ref_srt(L, LS, R, 1)->srt[4]);
+			break;
+		case 't':
+			lastack_pushvec4(LS, &ref_srt(L, LS, R, 1)->srt[8]);
+			break;
+		default:
+			return ref_get_key(L, LS, R->id, key);
+		}
+		lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+		return 1; }
 	default:
 		return luaL_error(L, "Invalid key type %s", lua_typename(L, type));
 	}
@@ -546,6 +803,18 @@ id_tostring(lua_State *L, int64_t id) {
 		lua_pushfstring(L, "QUAT (%f,%f,%f,%f)",
 			v[0], v[1], v[2], v[3]);
 		break;
+	case LINEAR_TYPE_AFFINE:
+		lua_pushfstring(L, "AFFINE (%f,%f,%f : %f,%f,%f : %f,%f,%f : %f,%f,%f)",
+			v[0],v[1],v[2],
+			v[3],v[4],v[5],
+			v[6],v[7],v[8],
+			v[9],v[10],v[11]);
+		break;
+	case LINEAR_TYPE_DUALQUAT:
+		lua_pushfstring(L, "DUALQUAT (%f,%f,%f,%f : %f,%f,%f,%f)",
+			v[0], v[1], v[2], v[3],
+			v[4], v[5], v[6], v[7]);
+		break;
 	default:
 		lua_pushstring(L, "Unknown");
 		break;
@@ -579,11 +848,128 @@ lref_gc(lua_State *L) {
 	return 0;
 }
 
+// refarray : N persistent ids in one userdata, upvalue 2 is the refarray metatable
+
+struct refarray {
+	int n;
+	int64_t id[1];
+};
+
+static inline struct refarray *
+check_refarray(lua_State *L, int index) {
+	struct refarray *RA = lua_touserdata(L, index);
+	if (!lua_getmetatable(L, index) || !lua_rawequal(L, -1, lua_upvalueindex(2)))
+		luaL_argerror(L, index, "Need a math3d refarray");
+	lua_pop(L, 1);
+	return RA;
+}
+
+static inline int64_t *
+refarray_slot(lua_State *L, struct refarray *RA, int index) {
+	int i = (int)luaL_checkinteger(L, index);
+	if (i < 1 || i > RA->n)
+		luaL_error(L, "Invalid refarray index %d (1-%d)", i, RA->n);
+	return &RA->id[i-1];
+}
+
+// math3d.refarray(n [, value]) : all the slots are Null, or the value
+static int
+lrefarray(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	lua_Integer n = luaL_checkinteger(L, 1);
+	if (n < 1 || n > (1 << 24))
+		return luaL_error(L, "Invalid refarray size %d", (int)n);
+	struct refarray *RA = lua_newuserdatauv(L, sizeof(*RA) + (n - 1) * sizeof(int64_t), 0);
+	RA->n = (int)n;
+	int64_t id = lua_isnoneornil(L, 2) ? 0 : get_id(L, 2, lua_type(L, 2));
+	int i;
+	for (i=0;i<n;i++) {
+		RA->id[i] = id ? lastack_mark(LS, id) : 0;
+	}
+	lua_pushvalue(L, lua_upvalueindex(2));
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+// refarray:set(i, key, value) : the same as ref[key] = value
+static int
+lrefarray_set(lua_State *L) {
+	struct refarray *RA = check_refarray(L, 1);
+	struct lastack *LS = GETLS(L);
+	int64_t *slot = refarray_slot(L, RA, 2);
+	const char *key = luaL_checkstring(L, 3);
+	int64_t oid = *slot;
+	*slot = ref_assign(L, LS, key, 4, oid);
+	lastack_unmark(LS, oid);
+	return 0;
+}
+
+// refarray:get(i [, key]) : the same as ref[key], key is "i" by default
+static int
+lrefarray_get(lua_State *L) {
+	struct refarray *RA = check_refarray(L, 1);
+	int64_t *slot = refarray_slot(L, RA, 2);
+	return ref_get_key(L, GETLS(L), *slot, luaL_optstring(L, 3, "i"));
+}
+
+static int
+lrefarray_index(lua_State *L) {
+	if (lua_type(L, 2) != LUA_TNUMBER) {
+		lua_pushvalue(L, 2);
+		lua_rawget(L, lua_upvalueindex(2));
+		return 1;
+	}
+	struct refarray *RA = lua_touserdata(L, 1);
+	lua_pushlightuserdata(L, STACKID(*refarray_slot(L, RA, 2)));
+	return 1;
+}
+
+// refarray[i] = id, nil for Null
+static int
+lrefarray_newindex(lua_State *L) {
+	struct refarray *RA = lua_touserdata(L, 1);
+	struct lastack *LS = GETLS(L);
+	int64_t *slot = refarray_slot(L, RA, 2);
+	int64_t oid = *slot;
+	*slot = lua_isnil(L, 3) ? 0 : ref_assign(L, LS, "i", 3, oid);
+	lastack_unmark(LS, oid);
+	return 0;
+}
+
+static int
+lrefarray_len(lua_State *L) {
+	struct refarray *RA = lua_touserdata(L, 1);
+	lua_pushinteger(L, RA->n);
+	return 1;
+}
+
+static int
+lrefarray_tostring(lua_State *L) {
+	struct refarray *RA = lua_touserdata(L, 1);
+	lua_pushfstring(L, "[refarray (%d)]", RA->n);
+	return 1;
+}
+
+static int
+lrefarray_gc(lua_State *L) {
+	struct refarray *RA = lua_touserdata(L, 1);
+	struct lastack *LS = GETLS(L);
+	int i;
+	for (i=0;i<RA->n;i++) {
+		lastack_unmark(LS, RA->id[i]);
+		RA->id[i] = 0;
+	}
+	return 0;
+}
+
 static int
 new_object(lua_State *L, int type, from_table_func from_table, int narray) { 
 	int argn = lua_gettop(L);
 	int64_t id;
-	if (argn == narray) {
+	if (lua_type(L, 1) == LUA_TSTRING && argn <= 2) {
+		// binary string [, offset]
+		id = object_from_string(L, GETLS(L), 1, type);
+	} else if (argn == narray) {
 		int i;
 		float tmp[16];
 		struct lastack *LS = GETLS(L);
@@ -777,9 +1163,19 @@ lmatrix(lua_State *L) {
 		struct lastack *LS = GETLS(L);
 		int64_t id = get_id(L, 1, lua_type(L, 1));
 		int type;
-		const float * quat = lastack_value(LS, id, &type);
-		if (quat && type == LINEAR_TYPE_QUAT) {
-			math3d_quat_to_matrix(LS, quat);
+		const float * v = lastack_value(LS, id, &type);
+		if (v && type == LINEAR_TYPE_QUAT) {
+			math3d_quat_to_matrix(LS, v);
+			lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+			return 1;
+		} else if (v && type == LINEAR_TYPE_AFFINE) {
+			float m[16];
+			math3d_affine_to_matrix(v, m);
+			lastack_pushmatrix(LS, m);
+			lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+			return 1;
+		} else if (v && type == LINEAR_TYPE_DUALQUAT) {
+			math3d_dualquat_to_matrix(LS, v);
 			lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
 			return 1;
 		}
@@ -787,10 +1183,53 @@ lmatrix(lua_State *L) {
 	return new_object(L, LINEAR_TYPE_MAT, matrix_from_table, 16);
 }
 
+// affine(m) : m is a matrix (the last row is dropped), an srt table or 12 numbers (4 columns of vec3).
+// affine values use 48 bytes (matrix 64 bytes), convert them by math3d.matrix() when the last row is needed.
+static int
+laffine(lua_State *L) {
+	if (lua_isuserdata(L, 1)) {
+		struct lastack *LS = GETLS(L);
+		int type;
+		const float * v = lastack_value(LS, get_id(L, 1, lua_type(L, 1)), &type);
+		if (v && type == LINEAR_TYPE_MAT) {
+			float a[12];
+			math3d_matrix_to_affine(v, a);
+			lastack_pushaffine(LS, a);
+			lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+			return 1;
+		}
+	}
+	return new_object(L, LINEAR_TYPE_AFFINE, affine_from_table, 12);
+}
+
+// dualquat(m) : m is a matrix (the scale is dropped), { r = quat, t = vector } or 8 numbers (real, dual).
+// dualquat(q [, t]) : rotation q and translation t
+static int
+ldualquat(lua_State *L) {
+	if (lua_isuserdata(L, 1)) {
+		struct lastack *LS = GETLS(L);
+		int type;
+		const float * v = lastack_value(LS, get_id(L, 1, lua_type(L, 1)), &type);
+		if (v && type == LINEAR_TYPE_QUAT) {
+			const float *t = object_from_index(L, LS, 2, LINEAR_TYPE_VEC4, vector_from_table);
+			math3d_make_dualquat(LS, v, t);
+			lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+			return 1;
+		} else if (v && (type == LINEAR_TYPE_MAT || type == LINEAR_TYPE_AFFINE)) {
+			math3d_matrix_to_dualquat(LS, matrix_from_index(L, LS, 1));
+			lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+			return 1;
+		}
+	}
+	return new_object(L, LINEAR_TYPE_DUALQUAT, dualquat_from_table, 8);
+}
+
 static int
 lvector(lua_State *L) {
 	int top = lua_gettop(L);
-	if (top == 3) {
+	if (lua_type(L, 1) == LUA_TSTRING) {
+		return new_object(L, LINEAR_TYPE_VEC4, vector_from_table, 4);
+	} else if (top == 3) {
 		lua_pushnumber(L, 0.0f);
 	} else if (top == 2) {
 		struct lastack *LS = GETLS(L);
@@ -829,80 +1268,640 @@ lquaternion(lua_State *L) {
 static int
 lsrt(lua_State *L) {
 	struct lastack *LS = GETLS(L);
-	const float * mat = matrix_from_index(L, LS, 1);
-	math3d_decompose_matrix(LS, mat);
+	int type = LINEAR_TYPE_NONE;
+	const float *v = lua_isuserdata(L, 1) ? lastack_value(LS, get_id(L, 1, lua_type(L, 1)), &type) : NULL;
+	if (v && type == LINEAR_TYPE_DUALQUAT) {
+		math3d_decompose_dualquat(LS, v);
+	} else {
+		math3d_decompose_matrix(LS, matrix_from_index(L, LS, 1));
+	}
 	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
 	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
 	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
-	return 3;	
+	return 3;
 }
 
-static int
-llength(lua_State *L) {
-	const float * v3 = vector_from_index(L, GETLS(L), 1);
-	lua_pushnumber(L, math3d_length(v3));
-	return 1;
+// array : n values of one type in a contiguous buffer, see larray
+
+#define ARRAY_ALIGN 16
+
+struct math3d_array {
+	float *ptr;	// aligned
+	int n;
+	int type;
+	int stride;	// floats per element
+	int handle;	// view handle of lastack
+	int readonly;
+};
+
+static const char * const array_types[] = { "m", "v", "q", "a", "d", NULL };	// LINEAR_TYPE_MAT/VEC4/QUAT/AFFINE/DUALQUAT
+
+// upvalue 2 : array metatable
+static struct math3d_array *
+to_array(lua_State *L, int index) {
+	if (lua_type(L, index) != LUA_TUSERDATA || !lua_getmetatable(L, index))
+		return NULL;
+	int eq = lua_rawequal(L, -1, lua_upvalueindex(2));
+	lua_pop(L, 1);
+	return eq ? (struct math3d_array *)lua_touserdata(L, index) : NULL;
+}
+
+static struct math3d_array *
+check_array(lua_State *L, int index) {
+	struct math3d_array *A = to_array(L, index);
+	if (A == NULL)
+		luaL_argerror(L, index, "Need a math3d array");
+	return A;
+}
+
+static inline struct math3d_array *
+check_array_type(lua_State *L, int index, int type) {
+	struct math3d_array *A = check_array(L, index);
+	if (A->type != type)
+		luaL_error(L, "Need a %s array, it's %s", lastack_typename(type), lastack_typename(A->type));
+	return A;
+}
+
+static inline struct math3d_array *
+writable_array(lua_State *L, struct math3d_array *A) {
+	if (A->readonly)
+		luaL_error(L, "The array is read only");
+	return A;
+}
+
+static inline float *
+array_element(lua_State *L, struct math3d_array *A, int index) {
+	if (index < 1 || index > A->n)
+		luaL_error(L, "Invalid array index %d (1-%d)", index, A->n);
+	return A->ptr + (size_t)(index - 1) * A->stride;
+}
+
+// push a new array of n values (uninitialized), upvalue 2 is the array metatable
+static struct math3d_array *
+new_array(lua_State *L, struct lastack *LS, int type, lua_Integer n) {
+	const int stride = lastack_typesize(type);
+	if (n < 0 || n > (1 << 24))
+		luaL_error(L, "Invalid array size %d", (int)n);
+	struct math3d_array *A = lua_newuserdatauv(L, sizeof(*A) + n * stride * sizeof(float) + ARRAY_ALIGN - 1, 0);
+	uintptr_t ptr = (uintptr_t)(A + 1);
+	A->ptr = (float *)((ptr + ARRAY_ALIGN - 1) & ~(uintptr_t)(ARRAY_ALIGN - 1));
+	A->n = (int)n;
+	A->type = type;
+	A->stride = stride;
+	A->handle = -1;
+	A->readonly = 0;
+	lua_pushvalue(L, lua_upvalueindex(2));
+	lua_setmetatable(L, -2);
+	A->handle = lastack_view_new(LS, A->ptr, A->n, stride, type);
+	if (A->handle < 0)
+		luaL_error(L, "Too many math3d arrays");
+	return A;
 }
 
+// math3d.array(type, n) : type is "m" (matrix), "v" (vector), "q" (quaternion), "a" (affine) or "d" (dualquat),
+// all values are initialized as identity.
+// math3d.array(type, str [, offset]) : decode all values from the binary string.
 static int
-lfloor(lua_State *L) {
+larray(lua_State *L) {
 	struct lastack *LS = GETLS(L);
-	const float * v = vector_from_index(L, LS, 1);
-	math3d_floor(LS, v);
-	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+	int type = luaL_checkoption(L, 1, NULL, array_types);
+	int stride = lastack_typesize(type);
+	if (lua_type(L, 2) == LUA_TSTRING) {
+		size_t len = lua_rawlen(L, 2);
+		lua_Integer offset = luaL_optinteger(L, 3, 1);
+		size_t bytes = (offset >= 1 && (size_t)offset <= len + 1) ? len - (offset - 1) : 0;
+		if (bytes % (stride * sizeof(float)) != 0)
+			return luaL_error(L, "Invalid binary string size %d", (int)bytes);
+		lua_Integer n = (lua_Integer)(bytes / (stride * sizeof(float)));
+		const char *src = binary_source(L, 2, n * stride * sizeof(float));
+		struct math3d_array *A = new_array(L, LS, type, n);
+		decode_floats(src, A->ptr, A->n * stride);
+	} else {
+		struct math3d_array *A = new_array(L, LS, type, luaL_checkinteger(L, 2));
+		const float *identity = lastack_value(LS, lastack_constant(type), NULL);
+		int i;
+		for (i=0;i<A->n;i++) {
+			memcpy(A->ptr + i * stride, identity, stride * sizeof(float));
+		}
+	}
 	return 1;
 }
 
+// math3d.view(ptr, n, stride, type [, readonly]) : wrap external memory as an array without copy,
+// stride is in bytes. The memory should be alive and not move while the view is in use.
 static int
-lceil(lua_State *L) {
+lview(lua_State *L) {
 	struct lastack *LS = GETLS(L);
-	const float * v = vector_from_index(L, LS, 1);
-	math3d_ceil(LS, v);
-	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+	luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+	float *ptr = (float *)lua_touserdata(L, 1);
+	lua_Integer n = luaL_checkinteger(L, 2);
+	lua_Integer stride = luaL_checkinteger(L, 3);
+	int type = luaL_checkoption(L, 4, NULL, array_types);
+	int readonly = lua_toboolean(L, 5);
+	if (n < 0 || n > (1 << 24))
+		return luaL_error(L, "Invalid view size %d", (int)n);
+	if (stride % sizeof(float) != 0 || stride < lastack_typesize(type) * (lua_Integer)sizeof(float))
+		return luaL_error(L, "Invalid view stride %d", (int)stride);
+	struct math3d_array *A = lua_newuserdatauv(L, sizeof(*A), 0);
+	A->ptr = ptr;
+	A->n = (int)n;
+	A->type = type;
+	A->stride = (int)(stride / sizeof(float));
+	A->readonly = readonly;
+	A->handle = lastack_view_new(LS, A->ptr, A->n, A->stride, type);
+	if (A->handle < 0)
+		return luaL_error(L, "Too many math3d arrays");
+	lua_pushvalue(L, lua_upvalueindex(2));
+	lua_setmetatable(L, -2);
 	return 1;
 }
 
+// array[i] returns an id refers to the element, it's valid until the array is collected.
+// After that it resolves to NULL, at least until math3d.reset.
 static int
-ldot(lua_State *L) {
-	struct lastack *LS = GETLS(L);
-	const float * v1 = vector_from_index(L, LS, 1);
-	const float * v2 = vector_from_index(L, LS, 2);
-	lua_pushnumber(L, math3d_dot(v1,v2));
+larray_index(lua_State *L) {
+	struct math3d_array *A = (struct math3d_array *)lua_touserdata(L, 1);
+	if (lua_type(L, 2) != LUA_TNUMBER) {
+		lua_settop(L, 2);
+		lua_rawget(L, lua_upvalueindex(2));
+		return 1;
+	}
+	int index = (int)luaL_checkinteger(L, 2);
+	int64_t id = lastack_viewid(GETLS(L), A->handle, index - 1);
+	if (id == 0)
+		return luaL_error(L, "Invalid array index %d (1-%d)", index, A->n);
+	lua_pushlightuserdata(L, STACKID(id));
 	return 1;
 }
 
 static int
-lcross(lua_State *L) {
-	struct lastack *LS = GETLS(L);
-	const float * v1 = vector_from_index(L, LS, 1);
-	const float * v2 = vector_from_index(L, LS, 2);
-	math3d_cross(LS, v1, v2);
-	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+larray_newindex(lua_State *L) {
+	struct math3d_array *A = writable_array(L, (struct math3d_array *)lua_touserdata(L, 1));
+	float *e = array_element(L, A, (int)luaL_checkinteger(L, 2));
+	memcpy(e, math3d_from_lua(L, GETLS(L), 3, A->type), lastack_typesize(A->type) * sizeof(float));
+	return 0;
+}
+
+static int
+larray_len(lua_State *L) {
+	struct math3d_array *A = (struct math3d_array *)lua_touserdata(L, 1);
+	lua_pushinteger(L, A->n);
 	return 1;
 }
 
 static int
-lnormalize(lua_State *L) {
-	int type;
-	struct lastack *LS = GETLS(L);
-	const float *v = get_object(L, LS, 1, &type);
-	switch (type) {
-	case LINEAR_TYPE_VEC4:
-		math3d_normalize_vector(LS, v);
-		break;
-	case LINEAR_TYPE_QUAT:
-		math3d_normalize_quat(LS, v);
-		break;
-	default:
-		return luaL_error(L, "normalize don't support %s", lastack_typename(type));
-	}
-	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+larray_tostring(lua_State *L) {
+	struct math3d_array *A = (struct math3d_array *)lua_touserdata(L, 1);
+	lua_pushfstring(L, "[array %s %d]", lastack_typename(A->type), A->n);
 	return 1;
 }
 
 static int
-ltranspose(lua_State *L) {
-	struct lastack *LS = GETLS(L);
+larray_gc(lua_State *L) {
+	struct math3d_array *A = (struct math3d_array *)lua_touserdata(L, 1);
+	if (A->handle >= 0) {
+		lastack_view_delete(GETLS(L), A->handle);
+		A->handle = -1;
+	}
+	return 0;
+}
+
+// array:fill(value [, from, to])
+static int
+larray_fill(lua_State *L) {
+	struct math3d_array *A = writable_array(L, check_array(L, 1));
+	const float *v = math3d_from_lua(L, GETLS(L), 2, A->type);
+	int from = (int)luaL_optinteger(L, 3, 1);
+	int to = (int)luaL_optinteger(L, 4, A->n);
+	if (from > to)
+		return 0;
+	array_element(L, A, from);
+	array_element(L, A, to);
+	const int size = lastack_typesize(A->type);
+	int i;
+	for (i=from;i<=to;i++) {
+		memcpy(A->ptr + (size_t)(i - 1) * A->stride, v, size * sizeof(float));
+	}
+	return 0;
+}
+
+// array:copy(source [, to]) : source is an array of the same type, a table of values or a binary string
+static int
+larray_copy(lua_State *L) {
+	struct math3d_array *A = writable_array(L, check_array(L, 1));
+	int to = (int)luaL_optinteger(L, 3, 1);
+	struct math3d_array *S = to_array(L, 2);
+	int n;
+	if (lua_type(L, 2) == LUA_TSTRING) {
+		size_t len;
+		const char *src = lua_tolstring(L, 2, &len);
+		const int size = lastack_typesize(A->type);
+		if (len % (size * sizeof(float)) != 0)
+			return luaL_error(L, "Invalid binary string size %d", (int)len);
+		n = (int)(len / (size * sizeof(float)));
+		if (n == 0)
+			return 0;
+		array_element(L, A, to);
+		array_element(L, A, to + n - 1);
+		int i;
+		for (i=0;i<n;i++) {
+			decode_floats(src + i * size * sizeof(float), A->ptr + (size_t)(to - 1 + i) * A->stride, size);
+		}
+		return 0;
+	} else if (S) {
+		if (S->type != A->type)
+			return luaL_error(L, "Can't copy array %s to %s", lastack_typename(S->type), lastack_typename(A->type));
+		n = S->n;
+	} else {
+		luaL_checktype(L, 2, LUA_TTABLE);
+		n = (int)lua_rawlen(L, 2);
+	}
+	if (n == 0)
+		return 0;
+	array_element(L, A, to);
+	array_element(L, A, to + n - 1);
+	float *dest = A->ptr + (size_t)(to - 1) * A->stride;
+	const int size = lastack_typesize(A->type);
+	if (S && S->stride == size && A->stride == size) {
+		memmove(dest, S->ptr, (size_t)n * size * sizeof(float));
+	} else if (S) {
+		// strided views : keep the interleaved data between elements
+		int i;
+		for (i=0;i<n;i++) {
+			memmove(dest + (size_t)i * A->stride, S->ptr + (size_t)i * S->stride, size * sizeof(float));
+		}
+	} else {
+		struct lastack *LS = GETLS(L);
+		int i;
+		for (i=0;i<n;i++) {
+			lua_geti(L, 2, i+1);
+			memcpy(dest + (size_t)i * A->stride, math3d_from_lua(L, LS, -1, A->type), size * sizeof(float));
+			lua_pop(L, 1);
+		}
+	}
+	return 0;
+}
+
+// transform_array(mat, source [, dest, w]) : dest[i] = mat * source[i], source/dest are vector arrays.
+// dest is source when it's omitted, w replaces source[i].w when it's not nil. mat can be a dualquat.
+static int
+ltransform_array(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	int type = LINEAR_TYPE_NONE;
+	const float *dq = lua_isuserdata(L, 1) ? lastack_value(LS, get_id(L, 1, lua_type(L, 1)), &type) : NULL;
+	const float *mat = (dq && type == LINEAR_TYPE_DUALQUAT) ? NULL : matrix_from_index(L, LS, 1);
+	struct math3d_array *S = check_array_type(L, 2, LINEAR_TYPE_VEC4);
+	struct math3d_array *D = lua_isnoneornil(L, 3) ? S : check_array_type(L, 3, LINEAR_TYPE_VEC4);
+	writable_array(L, D);
+	if (D->n < S->n)
+		return luaL_error(L, "Dest array is too small (%d < %d)", D->n, S->n);
+	float w;
+	const float *pw = NULL;
+	if (!lua_isnoneornil(L, 4)) {
+		w = (float)luaL_checknumber(L, 4);
+		pw = &w;
+	}
+	uint64_t trace_t = MATH3D_TRACE_BEGIN();
+	if (mat)
+		math3d_transform_array(mat, S->ptr, S->stride, S->n, pw, D->ptr, D->stride);
+	else
+		math3d_dualquat_transform_array(dq, S->ptr, S->stride, S->n, pw, D->ptr, D->stride);
+	MATH3D_TRACE_END("transform_array", trace_t, S->n);
+	return 0;
+}
+
+// array:pointer() returns lightuserdata, n, stride (in bytes)
+static int
+larray_pointer(lua_State *L) {
+	struct math3d_array *A = check_array(L, 1);
+	lua_pushlightuserdata(L, A->ptr);
+	lua_pushinteger(L, A->n);
+	lua_pushinteger(L, A->stride * sizeof(float));
+	return 3;
+}
+
+static float *
+optbuffer(lua_State *L, int index) {
+	if (lua_isnoneornil(L, index))
+		return NULL;
+	luaL_checktype(L, index, LUA_TLIGHTUSERDATA);
+	return (float *)lua_touserdata(L, index);
+}
+
+// batch source at index : a table of matrices, a matrix array, or (pointer, n) to n continuous matrices
+// returns n, *mats is NULL for a table or a strided matrix view (read by index), *next is the index after the source
+static int
+batch_source(lua_State *L, int index, const float **mats, int *next) {
+	int n;
+	struct math3d_array *A = to_array(L, index);
+	if (A) {
+		if (A->type != LINEAR_TYPE_MAT)
+			return luaL_error(L, "Need a matrix array");
+		*mats = A->stride == 16 ? A->ptr : NULL;
+		n = A->n;
+		*next = index + 1;
+	} else if (lua_type(L, index) == LUA_TLIGHTUSERDATA) {
+		*mats = (const float *)lua_touserdata(L, index);
+		n = luaL_checkinteger(L, index+1);
+		*next = index + 2;
+	} else {
+		luaL_checktype(L, index, LUA_TTABLE);
+		*mats = NULL;
+		n = lua_rawlen(L, index);
+		*next = index + 1;
+	}
+	if (n < 0)
+		return luaL_error(L, "Invalid matrix number %d", n);
+	return n;
+}
+
+static const float *
+batch_matrix(lua_State *L, struct lastack *LS, int index, const float *mats, int i) {
+	if (mats)
+		return mats + i * 16;
+	lua_geti(L, index, i+1);
+	const float *m = matrix_from_index(L, LS, -1);
+	lua_pop(L, 1);
+	return m;
+}
+
+// srt_array(source [, s, r, t])
+// s/r/t are lightuserdata buffers of n vec4 (nil to skip),
+// returns 3 binary strings of n vec4 when all buffers are omitted.
+static int
+lsrt_array(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	const float *mats;
+	int out;
+	int n = batch_source(L, 1, &mats, &out);
+	float *s, *r, *t;
+	int ret = lua_isnoneornil(L, out) && lua_isnoneornil(L, out+1) && lua_isnoneornil(L, out+2);
+	if (ret) {
+		s = (float *)lua_newuserdatauv(L, n * 12 * sizeof(float), 0);
+		r = s + n * 4;
+		t = r + n * 4;
+	} else {
+		s = optbuffer(L, out);
+		r = optbuffer(L, out+1);
+		t = optbuffer(L, out+2);
+	}
+	uint64_t trace_t = MATH3D_TRACE_BEGIN();
+	if (mats) {
+		math3d_decompose_matrix_array(mats, n, s, r, t);
+	} else {
+		int i;
+		for (i=0;i<n;i++) {
+			math3d_decompose_matrix_array(batch_matrix(L, LS, 1, NULL, i), 1,
+				s ? s + i * 4 : NULL,
+				r ? r + i * 4 : NULL,
+				t ? t + i * 4 : NULL);
+		}
+	}
+	MATH3D_TRACE_END("srt_array", trace_t, n);
+	if (!ret)
+		return 0;
+	lua_pushlstring(L, (const char *)s, n * 4 * sizeof(float));
+	lua_pushlstring(L, (const char *)r, n * 4 * sizeof(float));
+	lua_pushlstring(L, (const char *)t, n * 4 * sizeof(float));
+	return 3;
+}
+
+// normal_array(source, "3x3"/"3x4" [, out])
+// writes inverse-transpose of the upper 3x3 of each matrix into out (lightuserdata),
+// returns a binary string when out is omitted.
+static int
+lnormal_array(lua_State *L) {
+	static const char * const layouts[] = { "3x3", "3x4", NULL };
+	struct lastack *LS = GETLS(L);
+	const float *mats;
+	int layout;
+	int n = batch_source(L, 1, &mats, &layout);
+	const int stride = luaL_checkoption(L, layout, NULL, layouts) == 0 ? 9 : 12;
+	float *out = optbuffer(L, layout+1);
+	int ret = (out == NULL);
+	if (ret) {
+		out = (float *)lua_newuserdatauv(L, n * stride * sizeof(float), 0);
+	}
+	uint64_t trace_t = MATH3D_TRACE_BEGIN();
+	if (mats) {
+		math3d_normal_matrix_array(mats, n, out, stride);
+	} else {
+		int i;
+		for (i=0;i<n;i++) {
+			math3d_normal_matrix_array(batch_matrix(L, LS, 1, NULL, i), 1, out + i * stride, stride);
+		}
+	}
+	MATH3D_TRACE_END("normal_array", trace_t, n);
+	if (!ret)
+		return 0;
+	lua_pushlstring(L, (const char *)out, n * stride * sizeof(float));
+	return 1;
+}
+
+// batch output at index : nil, a lightuserdata buffer of n continuous values, or a writable array (or view) of the type
+static float *
+batch_output(lua_State *L, int index, int n, int type, int *stride) {
+	*stride = lastack_typesize(type);
+	if (lua_isnoneornil(L, index))
+		return NULL;
+	if (lua_type(L, index) == LUA_TLIGHTUSERDATA)
+		return (float *)lua_touserdata(L, index);
+	struct math3d_array *A = writable_array(L, check_array_type(L, index, type));
+	if (A->n < n)
+		luaL_error(L, "Output array is too small (%d < %d)", A->n, n);
+	*stride = A->stride;
+	return A->ptr;
+}
+
+// a position in double : a table of 3 numbers, or a vector
+static void
+double_from_index(lua_State *L, struct lastack *LS, int index, double v[3]) {
+	int i;
+	if (lua_type(L, index) == LUA_TTABLE && lua_rawlen(L, index) >= 3) {
+		for (i=0;i<3;i++) {
+			lua_geti(L, index, i+1);
+			v[i] = luaL_checknumber(L, -1);
+			lua_pop(L, 1);
+		}
+	} else {
+		const float *f = vector_from_index(L, LS, index);
+		for (i=0;i<3;i++)
+			v[i] = f[i];
+	}
+}
+
+// rebase_array(source [, low], origin, world [, view, worldview])
+// camera relative (origin rebased) world matrices, and view * world, of affine world matrices in one pass.
+//	source : float matrices (see batch_source) with the high part of the translation, low is an optional vector array of the low parts;
+//		or a binary string of double matrices (16 native doubles each).
+//	origin : the camera position in double, a table of 3 numbers or a vector.
+//	world / worldview : lightuserdata buffers or matrix arrays (a view can write into an instance buffer), nil to skip.
+//	view : the view matrix of the camera at (0,0,0).
+static int
+lrebase_array(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	const float *mats = NULL;
+	const char *dmats = NULL;
+	struct math3d_array *low = NULL;
+	int n, index;
+	if (lua_type(L, 1) == LUA_TSTRING) {
+		size_t sz;
+		dmats = lua_tolstring(L, 1, &sz);
+		if (sz % (16 * sizeof(double)) != 0)
+			return luaL_error(L, "Invalid double matrices size %d", (int)sz);
+		n = (int)(sz / (16 * sizeof(double)));
+		index = 2;
+	} else {
+		n = batch_source(L, 1, &mats, &index);
+		low = to_array(L, index);
+		if (low) {
+			if (low->type != LINEAR_TYPE_VEC4 || low->n < n)
+				return luaL_error(L, "Need a vector array of %d low parts", n);
+			++index;
+		}
+	}
+	double origin[3];
+	double_from_index(L, LS, index, origin);
+	int wstride, wvstride;
+	float *world = batch_output(L, index+1, n, LINEAR_TYPE_MAT, &wstride);
+	const float *view = lua_isnoneornil(L, index+2) ? NULL : matrix_from_index(L, LS, index+2);
+	float *worldview = batch_output(L, index+3, n, LINEAR_TYPE_MAT, &wvstride);
+	if (world == NULL && worldview == NULL)
+		return luaL_error(L, "Need world or worldview output");
+	if (worldview && view == NULL)
+		return luaL_error(L, "Need view matrix for worldview");
+	uint64_t trace_t = MATH3D_TRACE_BEGIN();
+	if (dmats) {
+		math3d_rebase_dmat_array((const double *)dmats, n, origin, view, world, wstride, worldview, wvstride);
+	} else if (mats) {
+		math3d_rebase_array(mats, low ? low->ptr : NULL, low ? low->stride : 0, n, origin, view, world, wstride, worldview, wvstride);
+	} else {
+		int i;
+		for (i=0;i<n;i++) {
+			math3d_rebase_array(batch_matrix(L, LS, 1, NULL, i), low ? low->ptr + (size_t)i * low->stride : NULL, 0, 1, origin, view,
+				world ? world + (size_t)i * wstride : NULL, 0,
+				worldview ? worldview + (size_t)i * wvstride : NULL, 0);
+		}
+	}
+	MATH3D_TRACE_END("rebase_array", trace_t, n);
+	return 0;
+}
+
+// dualquat_array(source [, out]) : the dual quaternion skinning palette of the matrices in source (see batch_source),
+// 8 floats for each bone. out is a lightuserdata buffer or a dualquat array, returns a binary string when it's omitted.
+static int
+ldualquat_array(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	const float *mats;
+	int out, stride;
+	int n = batch_source(L, 1, &mats, &out);
+	float *dq = batch_output(L, out, n, LINEAR_TYPE_DUALQUAT, &stride);
+	int ret = (dq == NULL);
+	if (ret) {
+		dq = (float *)lua_newuserdatauv(L, n * stride * sizeof(float), 0);
+	}
+	uint64_t trace_t = MATH3D_TRACE_BEGIN();
+	if (mats) {
+		math3d_dualquat_array(mats, n, dq, stride);
+	} else {
+		int i;
+		for (i=0;i<n;i++) {
+			math3d_dualquat_array(batch_matrix(L, LS, 1, NULL, i), 1, dq + (size_t)i * stride, stride);
+		}
+	}
+	MATH3D_TRACE_END("dualquat_array", trace_t, n);
+	if (!ret)
+		return 0;
+	lua_pushlstring(L, (const char *)dq, n * stride * sizeof(float));
+	return 1;
+}
+
+static const char * const precision_modes[] = { "exact", "fast", NULL };
+
+// optional "exact"/"fast" at index, default is math3d.precision()
+static int
+fast_math(lua_State *L, int index) {
+	if (lua_isnoneornil(L, index))
+		return g_default_fast_math;
+	return luaL_checkoption(L, index, NULL, precision_modes);
+}
+
+static int
+llength(lua_State *L) {
+	const float * v3 = vector_from_index(L, GETLS(L), 1);
+	lua_pushnumber(L, fast_math(L, 2) ? math3d_length_fast(v3) : math3d_length(v3));
+	return 1;
+}
+
+static int
+lfloor(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	const float * v = vector_from_index(L, LS, 1);
+	math3d_floor(LS, v);
+	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+	return 1;
+}
+
+static int
+lceil(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	const float * v = vector_from_index(L, LS, 1);
+	math3d_ceil(LS, v);
+	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+	return 1;
+}
+
+static int
+ldot(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	const float * v1 = vector_from_index(L, LS, 1);
+	const float * v2 = vector_from_index(L, LS, 2);
+	lua_pushnumber(L, math3d_dot(v1,v2));
+	return 1;
+}
+
+static int
+lcross(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	const float * v1 = vector_from_index(L, LS, 1);
+	const float * v2 = vector_from_index(L, LS, 2);
+	math3d_cross(LS, v1, v2);
+	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+	return 1;
+}
+
+static int
+lnormalize(lua_State *L) {
+	int type;
+	struct lastack *LS = GETLS(L);
+	const float *v = get_object(L, LS, 1, &type);
+	int fast = fast_math(L, 2);
+	switch (type) {
+	case LINEAR_TYPE_VEC4:
+		if (fast)
+			math3d_normalize_vector_fast(LS, v);
+		else
+			math3d_normalize_vector(LS, v);
+		break;
+	case LINEAR_TYPE_QUAT:
+		if (fast)
+			math3d_normalize_quat_fast(LS, v);
+		else
+			math3d_normalize_quat(LS, v);
+		break;
+	case LINEAR_TYPE_DUALQUAT:
+		math3d_normalize_dualquat(LS, v);
+		break;
+	default:
+		return luaL_error(L, "normalize don't support %s", lastack_typename(type));
+	}
+	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+	return 1;
+}
+
+static int
+ltranspose(lua_State *L) {
+	struct lastack *LS = GETLS(L);
 	const float * mat = matrix_from_index(L, LS, 1);
 	math3d_transpose_matrix(LS, mat);
 
@@ -926,6 +1925,12 @@ linverse(lua_State *L) {
 	case LINEAR_TYPE_MAT:
 		math3d_inverse_matrix(LS, v);
 		break;
+	case LINEAR_TYPE_AFFINE:
+		math3d_inverse_affine(LS, v);
+		break;
+	case LINEAR_TYPE_DUALQUAT:
+		math3d_inverse_dualquat(LS, v);
+		break;
 	default:
 		return luaL_error(L, "inverse don't support %s", lastack_typename(type));
 	}
@@ -962,7 +1967,10 @@ lreciprocal(lua_State *L) {
 	struct lastack *LS = GETLS(L);
 	const float * v = vector_from_index(L, LS, 1);
 
-	math3d_reciprocal(LS, v);
+	if (fast_math(L, 2))
+		math3d_reciprocal_fast(LS, v);
+	else
+		math3d_reciprocal(LS, v);
 	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
 	return 1;
 }
@@ -974,11 +1982,16 @@ ltodirection(lua_State *L) {
 	const float *v = get_object(L, LS, 1, &type);
 	switch (type) {
 	case LINEAR_TYPE_QUAT:
+	case LINEAR_TYPE_DUALQUAT:
 		math3d_quat_to_viewdir(LS, v);
 		break;
 	case LINEAR_TYPE_MAT:
 		math3d_rotmat_to_viewdir(LS, v);
 		break;
+	case LINEAR_TYPE_AFFINE: {
+		float z[4] = { 0, 0, 1, 0 };
+		math3d_affine_transform(LS, v, z);
+		break; }
 	default:
 		return luaL_error(L, "todirection don't support %s", lastack_typename(type));
 	}
@@ -995,25 +2008,64 @@ ltorotation(lua_State *L) {
 	return 1;
 }
 
+// totable(v [, t]) : fill t in place when it's given
 static int
 ltotable(lua_State *L){
 	struct lastack *LS = GETLS(L);
 	int64_t id = get_id(L, 1, lua_type(L, 1));
-	to_table(L, LS, id);
+	int dest = 0;
+	if (!lua_isnoneornil(L, 2)) {
+		luaL_checktype(L, 2, LUA_TTABLE);
+		dest = 2;
+	}
+	to_table(L, LS, id, dest);
 	return 1;
 }
 
+// unpack(v) : returns all the numbers of v
+static int
+lunpack(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	int type;
+	const float *v = lastack_value(LS, get_id(L, 1, lua_type(L, 1)), &type);
+	if (v == NULL)
+		return luaL_argerror(L, 1, "Invalid math3d value");
+	int n = lastack_typesize(type);
+	int i;
+	luaL_checkstack(L, n, NULL);
+	for (i=0;i<n;i++) {
+		lua_pushnumber(L, v[i]);
+	}
+	return n;
+}
+
+// Returns a, b as two temp vectors, or write them into the vector array at index (slot index+1 and index+2)
+static int
+output_vec4_pair(lua_State *L, struct lastack *LS, int index, const float a[4], const float b[4]) {
+	if (lua_isnoneornil(L, index)) {
+		lastack_pushvec4(LS, a);
+		lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+		lastack_pushvec4(LS, b);
+		lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+		return 2;
+	}
+	struct math3d_array *A = writable_array(L, check_array_type(L, index, LINEAR_TYPE_VEC4));
+	int slot = (int)luaL_optinteger(L, index + 1, 1);
+	memcpy(array_element(L, A, slot), a, 4 * sizeof(float));
+	memcpy(array_element(L, A, slot + 1), b, 4 * sizeof(float));
+	return 0;
+}
+
+// base_axes(forward [, array, slot]) returns right, up
 static int
 lbase_axes(lua_State *L) {
 	struct lastack *LS = GETLS(L);
 
 	const float *forward = vector_from_index(L, LS, 1);
 
-	math3d_base_axes(LS, forward);
-
-	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));	// right
-	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));	// up
-	return 2;
+	float right[4], up[4];
+	math3d_base_axes(forward, right, up);
+	return output_vec4_pair(L, LS, 2, right, up);
 }
 
 static int
@@ -1051,8 +2103,14 @@ ltransform(lua_State *L){
 	case LINEAR_TYPE_MAT:
 		math3d_rotmat_transform(LS, rotator, v);
 		break;
+	case LINEAR_TYPE_AFFINE:
+		math3d_affine_transform(LS, rotator, v);
+		break;
+	case LINEAR_TYPE_DUALQUAT:
+		math3d_dualquat_transform(LS, rotator, v);
+		break;
 	default: 
-		return luaL_error(L, "only support quat/mat for rotate vector:%s", lastack_typename(type));
+		return luaL_error(L, "only support quat/mat/affine/dualquat for rotate vector:%s", lastack_typename(type));
 	}
 
 	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
@@ -1132,16 +2190,25 @@ lprojmat(lua_State *L) {
 	return 1;
 }
 
+// minmax(points [, transform, array, slot]) returns min, max
 static int
 lminmax(lua_State *L){
 	struct lastack *LS = GETLS(L);
 
-	luaL_checktype(L, 1, LUA_TTABLE);
-	const int numpoints = (int)lua_rawlen(L, 1);
+	struct math3d_array *A = to_array(L, 1);
+	if (A == NULL)
+		luaL_checktype(L, 1, LUA_TTABLE);
+	const int numpoints = A ? 0 : (int)lua_rawlen(L, 1);
 
 	const float* transform = lua_isnoneornil(L, 2) ? NULL : matrix_from_index(L, LS, 2);
 	float minv[4] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
 	float maxv[4] = {-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX};
+	if (A) {
+		check_array_type(L, 1, LINEAR_TYPE_VEC4);
+		uint64_t trace_t = MATH3D_TRACE_BEGIN();
+		math3d_minmax_array(transform, A->ptr, A->stride, A->n, minv, maxv);
+		MATH3D_TRACE_END("minmax_array", trace_t, A->n);
+	}
 	for (int ii = 0; ii < numpoints; ++ii){
 		float v[4];
 		lua_geti(L, 1, ii+1);
@@ -1150,11 +2217,7 @@ lminmax(lua_State *L){
 		math3d_minmax(LS, transform, v, minv, maxv);
 	}
 
-	lastack_pushvec4(LS, minv);
-	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
-	lastack_pushvec4(LS, maxv);
-	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
-	return 2;
+	return output_vec4_pair(L, LS, 3, minv, maxv);
 }
 
 static int
@@ -1173,11 +2236,13 @@ llerp(lua_State *L){
 	return 1;
 }
 
+// returns memory size, number of temps since last reset
 static int
 lstacksize(lua_State *L) {
 	struct lastack *LS = GETLS(L);
 	lua_pushinteger(L, lastack_size(LS));
-	return 1;
+	lua_pushinteger(L, lastack_temps(LS));
+	return 2;
 }
 
 static int
@@ -1192,42 +2257,15 @@ lhomogeneous_depth(lua_State *L){
 	return 1;
 }
 
+// precision() returns current mode, precision("exact"/"fast") sets the default mode
+// of normalize/length/reciprocal
 static int
-lpack(lua_State *L) {
-	size_t sz;
-	const char * format = luaL_checklstring(L, 1, &sz);
-	int n = lua_gettop(L);
-	int i;
-	if (n != 5 && n != 17) {
-		return luaL_error(L, "need 5 or 17 arguments , it's %d", n);
-	}
-	--n;
-	if (n != sz) {
-		return luaL_error(L, "Invalid format %s", format);
-	}
-	union {
-		float f[16];
-		uint32_t n[16];
-	} u;
-	for (i=0;i<n;i++) {
-		switch(format[i]) {
-		case 'f':
-			u.f[i] = luaL_checknumber(L, i+2);
-			break;
-		case 'd':
-			u.n[i] = luaL_checkinteger(L, i+2);
-			break;
-		default:
-			return luaL_error(L, "Invalid format %s", format);
-		}
-	}
-	struct lastack *LS = GETLS(L);
-	if (n == 4) {
-		lastack_pushvec4(LS, u.f);
-	} else {
-		lastack_pushmatrix(LS, u.f);
+lprecision(lua_State *L) {
+	if (lua_gettop(L) > 0) {
+		g_default_fast_math = luaL_checkoption(L, 1, NULL, precision_modes);
+		return 0;
 	}
-	lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+	lua_pushstring(L, precision_modes[g_default_fast_math]);
 	return 1;
 }
 
@@ -1246,19 +2284,1023 @@ ldir2radian(lua_State *L){
 	return 2;
 }
 
+// serialize : uint8 version, then little-endian binary records
+//	uint8 tag : type (LINEAR_TYPE_*) | SERIALIZE_ARRAY | SERIALIZE_QUANTIZED
+//	uint32 n : only for array
+//	values : mat float[16], vec4/quat float[4], affine float[12], dualquat float[8]
+//		quantized vec4 : half[4] , or snorm16[3] (xyz - origin * w) / range and half w after a frame record
+//		quantized quat : snorm16[4]
+//	frame record : uint8 SERIALIZE_FRAME, float origin[3], float range
+
+#define SERIALIZE_VERSION 0x81	// out of the tag range, bump the low bits when the layout changes
+#define SERIALIZE_TYPEMASK 0x7
+#define SERIALIZE_ARRAY 0x8
+#define SERIALIZE_QUANTIZED 0x10
+#define SERIALIZE_FRAME 0x20
+#define SERIALIZE_HALF_MAX 65504.0f
+
+// range == 0 : quantize vec4 to half floats
+struct serialize_frame {
+	float origin[3];
+	float range;
+};
+
+static inline void
+encode_u32(char *p, uint32_t u) {
+	p[0] = (char)(u & 0xff);
+	p[1] = (char)((u >> 8) & 0xff);
+	p[2] = (char)((u >> 16) & 0xff);
+	p[3] = (char)(u >> 24);
+}
+
+static inline uint32_t
+decode_u32(const char *p) {
+	const unsigned char *b = (const unsigned char *)p;
+	return b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+static inline void
+encode_floats(char *p, const float *v, int n) {
+	int i;
+	for (i=0;i<n;i++) {
+		uint32_t u;
+		memcpy(&u, &v[i], sizeof(u));
+		encode_u32(p + i * 4, u);
+	}
+}
+
+static inline void
+encode_u16(char *p, uint16_t v) {
+	p[0] = (char)(v & 0xff);
+	p[1] = (char)(v >> 8);
+}
+
+static inline uint16_t
+decode_u16(const char *p) {
+	const unsigned char *b = (const unsigned char *)p;
+	return (uint16_t)(b[0] | b[1] << 8);
+}
+
+// round to nearest even
+static uint16_t
+float_to_half(float f) {
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+	const uint32_t sign = (x >> 16) & 0x8000;
+	const uint32_t fexp = (x >> 23) & 0xff;
+	uint32_t mant = x & 0x7fffff;
+	if (fexp == 0xff)	// inf or nan
+		return (uint16_t)(sign | 0x7c00 | (mant ? 0x200 : 0));
+	int exp = (int)fexp - 127 + 15;
+	if (exp >= 31)
+		return (uint16_t)(sign | 0x7c00);
+	uint32_t h, rem, half;
+	if (exp <= 0) {
+		// subnormal
+		if (exp < -10)
+			return (uint16_t)sign;
+		mant |= 0x800000;
+		const int shift = 14 - exp;
+		h = mant >> shift;
+		rem = mant & ((1u << shift) - 1);
+		half = 1u << (shift - 1);
+	} else {
+		h = (uint32_t)exp << 10 | mant >> 13;
+		rem = mant & 0x1fff;
+		half = 0x1000;
+	}
+	if (rem > half || (rem == half && (h & 1)))
+		++h;	// may carry into exponent, it's still correct
+	return (uint16_t)(sign | h);
+}
+
+static float
+half_to_float(uint16_t h) {
+	const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exp = (h >> 10) & 0x1f;
+	uint32_t mant = h & 0x3ff;
+	uint32_t x;
+	if (exp == 0) {
+		if (mant == 0) {
+			x = sign;
+		} else {
+			// subnormal
+			exp = 127 - 15 + 1;
+			while (!(mant & 0x400)) {
+				mant <<= 1;
+				--exp;
+			}
+			x = sign | exp << 23 | (mant & 0x3ff) << 13;
+		}
+	} else if (exp == 31) {
+		x = sign | 0x7f800000 | mant << 13;
+	} else {
+		x = sign | (exp + 127 - 15) << 23 | mant << 13;
+	}
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+static inline int
+serialize_size(int tag) {
+	if (tag & SERIALIZE_QUANTIZED)
+		return 8;
+	return lastack_typesize(tag & SERIALIZE_TYPEMASK) * sizeof(float);
+}
+
+// returns 0 when a quantized vec4 is out of range
+static int
+serialize_value(char *p, const float *v, int tag, const struct serialize_frame *F) {
+	int i;
+	if (!(tag & SERIALIZE_QUANTIZED)) {
+		encode_floats(p, v, lastack_typesize(tag & SERIALIZE_TYPEMASK));
+	} else if ((tag & SERIALIZE_TYPEMASK) == LINEAR_TYPE_QUAT) {
+		for (i=0;i<4;i++) {
+			float c = v[i] > 1.0f ? 1.0f : (v[i] < -1.0f ? -1.0f : v[i]);
+			encode_u16(p + i * 2, (uint16_t)(int16_t)lrintf(c * 32767.0f));
+		}
+	} else if (F->range > 0) {
+		if (!(fabsf(v[3]) <= SERIALIZE_HALF_MAX))
+			return 0;
+		for (i=0;i<3;i++) {
+			float d = (v[i] - F->origin[i] * v[3]) / F->range;
+			if (!(fabsf(d) <= 1.0f))
+				return 0;
+			encode_u16(p + i * 2, (uint16_t)(int16_t)lrintf(d * 32767.0f));
+		}
+		encode_u16(p + 6, float_to_half(v[3]));
+	} else {
+		for (i=0;i<4;i++) {
+			if (!(fabsf(v[i]) <= SERIALIZE_HALF_MAX))
+				return 0;
+			encode_u16(p + i * 2, float_to_half(v[i]));
+		}
+	}
+	return 1;
+}
+
+static void
+deserialize_value(const char *p, float *v, int tag, const struct serialize_frame *F) {
+	int i;
+	if (!(tag & SERIALIZE_QUANTIZED)) {
+		decode_floats(p, v, lastack_typesize(tag & SERIALIZE_TYPEMASK));
+	} else if ((tag & SERIALIZE_TYPEMASK) == LINEAR_TYPE_QUAT) {
+		float len = 0;
+		for (i=0;i<4;i++) {
+			v[i] = (int16_t)decode_u16(p + i * 2) / 32767.0f;
+			len += v[i] * v[i];
+		}
+		if (len > 0) {
+			len = 1.0f / sqrtf(len);
+			for (i=0;i<4;i++) {
+				v[i] *= len;
+			}
+		}
+	} else if (F->range > 0) {
+		v[3] = half_to_float(decode_u16(p + 6));
+		for (i=0;i<3;i++) {
+			v[i] = (int16_t)decode_u16(p + i * 2) / 32767.0f * F->range + F->origin[i] * v[3];
+		}
+	} else {
+		for (i=0;i<4;i++) {
+			v[i] = half_to_float(decode_u16(p + i * 2));
+		}
+	}
+}
+
+static int
+serialize_error(lua_State *L, const float *v) {
+	return luaL_error(L, "Position (%f, %f, %f, %f) is out of the quantize range", v[0], v[1], v[2], v[3]);
+}
+
+static inline int
+serialize_tag(int type, const int quantize[LINEAR_TYPE_COUNT]) {
+	return type | (quantize[type] ? SERIALIZE_QUANTIZED : 0);
+}
+
+// math3d.serialize([options,] values...) : values are ids, refs or arrays.
+// options :
+//	quat = true : quantizes quats to snorm16.
+//	position = true : quantizes vec4 to half floats, 11 significant bits (step 0.5 at 1000, 32 at 65504).
+//	position = { range = r [, origin = v] } : quantizes xyz - origin * w to snorm16 in [-r, r], the step is r / 32767
+//		(3cm in 1km), and w to a half float. Use it for world positions.
+//	Out of range vec4 raise an error.
+static int
+lserialize(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	int quantize[LINEAR_TYPE_COUNT] = { 0, 0, 0, 0, 0 };
+	struct serialize_frame frame = { { 0, 0, 0 }, 0 };
+	int from = 1;
+	if (lua_type(L, 1) == LUA_TTABLE) {
+		lua_getfield(L, 1, "quat");
+		quantize[LINEAR_TYPE_QUAT] = lua_toboolean(L, -1);
+		lua_pop(L, 1);
+		if (lua_getfield(L, 1, "position") == LUA_TTABLE) {
+			lua_getfield(L, -1, "range");
+			frame.range = (float)luaL_checknumber(L, -1);
+			if (!(frame.range > 0))
+				return luaL_error(L, "Invalid position range %f", frame.range);
+			if (lua_getfield(L, -2, "origin") != LUA_TNIL) {
+				const float *origin = vector_from_index(L, LS, lua_gettop(L));
+				memcpy(frame.origin, origin, sizeof(frame.origin));
+			}
+			lua_pop(L, 2);
+		}
+		quantize[LINEAR_TYPE_VEC4] = lua_toboolean(L, -1);
+		lua_pop(L, 1);
+		from = 2;
+	}
+	const int top = lua_gettop(L);
+	uint64_t trace_t = MATH3D_TRACE_BEGIN();
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	luaL_addchar(&b, (char)SERIALIZE_VERSION);
+	if (frame.range > 0) {
+		char *p = luaL_prepbuffsize(&b, 17);
+		p[0] = (char)SERIALIZE_FRAME;
+		encode_floats(p + 1, frame.origin, 3);
+		encode_floats(p + 13, &frame.range, 1);
+		luaL_addsize(&b, 17);
+	}
+	int i, j;
+	for (i=from;i<=top;i++) {
+		struct math3d_array *A = to_array(L, i);
+		if (A) {
+			const int tag = serialize_tag(A->type, quantize) | SERIALIZE_ARRAY;
+			const int size = serialize_size(tag);
+			char head[5];
+			head[0] = (char)tag;
+			encode_u32(head + 1, (uint32_t)A->n);
+			luaL_addlstring(&b, head, 5);
+			for (j=0;j<A->n;j++) {
+				const float *v = A->ptr + (size_t)j * A->stride;
+				if (!serialize_value(luaL_prepbuffsize(&b, size), v, tag, &frame))
+					return serialize_error(L, v);
+				luaL_addsize(&b, size);
+			}
+		} else {
+			int type;
+			const float *v = lastack_value(LS, get_id(L, i, lua_type(L, i)), &type);
+			if (v == NULL)
+				return luaL_argerror(L, i, "Invalid math3d value");
+			const int tag = serialize_tag(type, quantize);
+			const int size = serialize_size(tag);
+			char *p = luaL_prepbuffsize(&b, size + 1);
+			p[0] = (char)tag;
+			if (!serialize_value(p + 1, v, tag, &frame))
+				return serialize_error(L, v);
+			luaL_addsize(&b, size + 1);
+		}
+	}
+	luaL_pushresult(&b);
+	MATH3D_TRACE_END("serialize", trace_t, top - from + 1);
+	return 1;
+}
+
+static void
+deserialize_toref(lua_State *L, struct lastack *LS, int index, int64_t id) {
+	if (lua_type(L, index) != LUA_TUSERDATA || lua_rawlen(L, index) != sizeof(struct refobject))
+		luaL_error(L, "Need a ref to deserialize value");
+	struct refobject *R = (struct refobject *)lua_touserdata(L, index);
+	int64_t oid = R->id;
+	R->id = lastack_mark(LS, id);
+	lastack_unmark(LS, oid);
+}
+
+// math3d.deserialize(str [, target]) returns values in str.
+//	target nil : values are temp ids , arrays are new math3d arrays
+//	target "ref" : values are new refs
+//	target table : write values into the refs/arrays in the table, returns the number of values
+// upvalue 3 : ref metatable
+static int
+ldeserialize(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	size_t sz;
+	const char *p = luaL_checklstring(L, 1, &sz);
+	const char *end = p + sz;
+	int totable = lua_type(L, 2) == LUA_TTABLE;
+	int toref = !totable && !lua_isnoneornil(L, 2);
+	if (toref && strcmp(luaL_checkstring(L, 2), "ref") != 0)
+		return luaL_argerror(L, 2, "Need \"ref\" or a table");
+	lua_settop(L, 2);
+	if (p == end || (unsigned char)*p != SERIALIZE_VERSION)
+		return luaL_error(L, "Unsupported serialize version (first byte %d)", p == end ? -1 : (unsigned char)*p);
+	++p;
+	uint64_t trace_t = MATH3D_TRACE_BEGIN();
+	struct serialize_frame frame = { { 0, 0, 0 }, 0 };
+	int n = 0;
+	while (p < end) {
+		const int tag = (unsigned char)*p;
+		if (tag == SERIALIZE_FRAME) {
+			if (end - p < 17)
+				return luaL_error(L, "Invalid serialize data");
+			decode_floats(p + 1, frame.origin, 3);
+			decode_floats(p + 13, &frame.range, 1);
+			if (!(frame.range > 0))
+				return luaL_error(L, "Invalid serialize position range %f", frame.range);
+			p += 17;
+			continue;
+		}
+		const int type = tag & SERIALIZE_TYPEMASK;
+		if (type >= LINEAR_TYPE_COUNT || (tag & ~(SERIALIZE_TYPEMASK | SERIALIZE_ARRAY | SERIALIZE_QUANTIZED)))
+			return luaL_error(L, "Invalid serialize tag %d", (unsigned char)*p);
+		++p;
+		const int size = serialize_size(tag);
+		int count = 1;
+		if (tag & SERIALIZE_ARRAY) {
+			if (end - p < 4)
+				return luaL_error(L, "Invalid serialize data");
+			uint32_t un = decode_u32(p);
+			p += 4;
+			if (un > (1 << 24) || (size_t)(end - p) / size < un)
+				return luaL_error(L, "Invalid serialize array size %I", (lua_Integer)un);
+			count = (int)un;
+		} else if (end - p < size) {
+			return luaL_error(L, "Invalid serialize data");
+		}
+		++n;
+		luaL_checkstack(L, 2, NULL);
+		int i;
+		if (tag & SERIALIZE_ARRAY) {
+			struct math3d_array *A;
+			if (totable) {
+				lua_geti(L, 2, n);
+				A = to_array(L, -1);
+				if (A == NULL || A->type != type || A->readonly || A->n < count)
+					return luaL_error(L, "Target %d should be a writable %s array of %d", n, lastack_typename(type), count);
+				lua_pop(L, 1);
+			} else {
+				A = new_array(L, LS, type, count);
+			}
+			for (i=0;i<count;i++) {
+				deserialize_value(p + (size_t)i * size, A->ptr + (size_t)i * A->stride, tag, &frame);
+			}
+			p += (size_t)count * size;
+		} else {
+			float v[16];
+			deserialize_value(p, v, tag, &frame);
+			p += size;
+			lastack_pushobject(LS, v, type);
+			int64_t id = lastack_pop(LS);
+			if (totable) {
+				lua_geti(L, 2, n);
+				deserialize_toref(L, LS, -1, id);
+				lua_pop(L, 1);
+			} else if (toref) {
+				struct refobject *R = lua_newuserdatauv(L, sizeof(struct refobject), 1);
+				R->id = lastack_mark(LS, id);
+				lua_pushvalue(L, lua_upvalueindex(3));
+				lua_setmetatable(L, -2);
+			} else {
+				lua_pushlightuserdata(L, STACKID(id));
+			}
+		}
+	}
+	MATH3D_TRACE_END("deserialize", trace_t, n);
+	if (totable) {
+		lua_pushinteger(L, n);
+		return 1;
+	}
+	return n;
+}
+
+// program : compiled list of math instructions, see lprogram
+
+#define PROGRAM_MAXREG 128
+
+struct program {
+	int ninput;
+	int ncode;
+	int noutput;
+	uint8_t type[PROGRAM_MAXREG];	// type of each register
+	uint8_t output[PROGRAM_MAXREG];	// output registers
+	struct math3d_instruction code[PROGRAM_MAXREG];
+};
+
+#define PM LINEAR_TYPE_MAT
+#define PV LINEAR_TYPE_VEC4
+#define PQ LINEAR_TYPE_QUAT
+#define PN LINEAR_TYPE_NUM
+
+static const struct program_opdef {
+	const char *name;
+	int op;
+	int result;
+	int n;
+	int arg[3];
+	int swap;	// swap the first two arguments
+} program_ops[] = {
+	{ "mul", MATH3D_OP_MUL_MAT, PM, 2, { PM, PM } },
+	{ "mul", MATH3D_OP_MUL_QUAT, PQ, 2, { PQ, PQ } },
+	{ "mul", MATH3D_OP_MUL_VEC, PV, 2, { PV, PV } },
+	{ "mul", MATH3D_OP_SCALE_VEC, PV, 2, { PV, PN } },
+	{ "mul", MATH3D_OP_SCALE_VEC, PV, 2, { PN, PV }, 1 },
+	{ "add", MATH3D_OP_ADD, PV, 2, { PV, PV } },
+	{ "sub", MATH3D_OP_SUB, PV, 2, { PV, PV } },
+	{ "transform", MATH3D_OP_TRANSFORM_QUAT, PV, 2, { PQ, PV } },
+	{ "transform", MATH3D_OP_TRANSFORM_MAT, PV, 2, { PM, PV } },
+	{ "transformH", MATH3D_OP_TRANSFORMH, PV, 2, { PM, PV } },
+	{ "inverse", MATH3D_OP_INVERSE_MAT, PM, 1, { PM } },
+	{ "inverse", MATH3D_OP_INVERSE_QUAT, PQ, 1, { PQ } },
+	{ "inverse", MATH3D_OP_INVERSE_VEC, PV, 1, { PV } },
+	{ "transpose", MATH3D_OP_TRANSPOSE, PM, 1, { PM } },
+	{ "normalize", MATH3D_OP_NORMALIZE_VEC, PV, 1, { PV } },
+	{ "normalize", MATH3D_OP_NORMALIZE_QUAT, PQ, 1, { PQ } },
+	{ "lookat", MATH3D_OP_LOOKAT, PM, 2, { PV, PV } },
+	{ "lookat", MATH3D_OP_LOOKAT, PM, 3, { PV, PV, PV } },
+	{ "lookto", MATH3D_OP_LOOKTO, PM, 2, { PV, PV } },
+	{ "lookto", MATH3D_OP_LOOKTO, PM, 3, { PV, PV, PV } },
+	{ "matrix", MATH3D_OP_QUAT_TO_MAT, PM, 1, { PQ } },
+	{ "quaternion", MATH3D_OP_MAT_TO_QUAT, PQ, 1, { PM } },
+	{ "srt", MATH3D_OP_SRT, PM, 3, { PV, PQ, PV } },
+	{ "cross", MATH3D_OP_CROSS, PV, 2, { PV, PV } },
+	{ "dot", MATH3D_OP_DOT, PN, 2, { PV, PV } },
+	{ "length", MATH3D_OP_LENGTH, PN, 1, { PV } },
+	{ "lerp", MATH3D_OP_LERP, PV, 3, { PV, PV, PN } },
+	{ "reciprocal", MATH3D_OP_RECIPROCAL, PV, 1, { PV } },
+	{ "todirection", MATH3D_OP_TODIRECTION_QUAT, PV, 1, { PQ } },
+	{ "todirection", MATH3D_OP_TODIRECTION_MAT, PV, 1, { PM } },
+	{ NULL },
+};
+
+#undef PM
+#undef PV
+#undef PQ
+#undef PN
+
+static const char *
+program_typename(int type) {
+	return type == LINEAR_TYPE_NUM ? "number" : lastack_typename(type);
+}
+
+static void
+program_instruction(lua_State *L, struct program *P, int index, int pc) {
+	const int reg = P->ninput + pc;
+	if (lua_geti(L, index, pc+1) != LUA_TTABLE)
+		luaL_error(L, "Program instruction %d should be a table", pc+1);
+	if (lua_geti(L, -1, 1) != LUA_TSTRING)
+		luaL_error(L, "Program instruction %d need an op name", pc+1);
+	const char *name = lua_tostring(L, -1);
+	lua_pop(L, 1);
+	int n = (int)lua_rawlen(L, -1) - 1;
+	if (n < 1 || n > 3)
+		luaL_error(L, "Program instruction %d (%s) has %d arguments", pc+1, name, n);
+	int arg[3];
+	int type[3];
+	int i;
+	for (i=0;i<n;i++) {
+		int isint;
+		lua_geti(L, -1, i+2);
+		int r = (int)lua_tointegerx(L, -1, &isint);
+		lua_pop(L, 1);
+		if (!isint || r < 1 || r > reg)
+			luaL_error(L, "Program instruction %d (%s) : invalid register at argument %d", pc+1, name, i+1);
+		arg[i] = r - 1;
+		type[i] = P->type[r - 1];
+	}
+	lua_pop(L, 1);
+	const struct program_opdef *def;
+	for (def = program_ops; def->name; def++) {
+		if (def->n == n && strcmp(def->name, name) == 0) {
+			for (i=0;i<n;i++) {
+				if (def->arg[i] != type[i])
+					break;
+			}
+			if (i == n)
+				break;
+		}
+	}
+	if (def->name == NULL) {
+		luaL_error(L, "Program instruction %d : no %s (%s, %s, %s)", pc+1, name,
+			program_typename(type[0]),
+			n > 1 ? program_typename(type[1]) : "-",
+			n > 2 ? program_typename(type[2]) : "-");
+	}
+	struct math3d_instruction *inst = &P->code[pc];
+	inst->op = def->op;
+	inst->arg[0] = def->swap ? arg[1] : arg[0];
+	inst->arg[1] = n < 2 ? 0 : (def->swap ? arg[0] : arg[1]);
+	inst->arg[2] = n < 3 ? MATH3D_NOARG : arg[2];
+	P->type[reg] = def->result;
+}
+
+static void
+program_output_register(lua_State *L, struct program *P, int index) {
+	int isint;
+	int r = (int)lua_tointegerx(L, index, &isint);
+	if (!isint || r < 1 || r > P->ninput + P->ncode)
+		luaL_error(L, "Invalid program output register");
+	if (P->noutput >= PROGRAM_MAXREG)
+		luaL_error(L, "Too many program outputs");
+	P->output[P->noutput++] = r - 1;
+}
+
+static void
+program_compile(lua_State *L, struct program *P, int index) {
+	size_t sz = 0;
+	const char *input = "";
+	int i;
+	if (lua_getfield(L, index, "input") != LUA_TNIL) {
+		if (lua_type(L, -1) != LUA_TSTRING)
+			luaL_error(L, "Program input should be a format string");
+		input = lua_tolstring(L, -1, &sz);
+	}
+	P->ncode = (int)lua_rawlen(L, index);
+	if (sz + P->ncode > PROGRAM_MAXREG)
+		luaL_error(L, "Too many program registers (%d)", (int)sz + P->ncode);
+	P->ninput = (int)sz;
+	P->noutput = 0;
+	for (i=0;i<P->ninput;i++) {
+		switch (input[i]) {
+		case 'm':
+			P->type[i] = LINEAR_TYPE_MAT;
+			break;
+		case 'v':
+			P->type[i] = LINEAR_TYPE_VEC4;
+			break;
+		case 'q':
+			P->type[i] = LINEAR_TYPE_QUAT;
+			break;
+		case 'n':
+			P->type[i] = LINEAR_TYPE_NUM;
+			break;
+		default:
+			luaL_error(L, "Invalid program input %s", input);
+		}
+	}
+	lua_pop(L, 1);
+	for (i=0;i<P->ncode;i++) {
+		program_instruction(L, P, index, i);
+	}
+	switch (lua_getfield(L, index, "output")) {
+	case LUA_TNIL:
+		if (P->ncode == 0)
+			luaL_error(L, "Program need an output");
+		P->output[P->noutput++] = P->ninput + P->ncode - 1;
+		break;
+	case LUA_TTABLE: {
+		int n = (int)lua_rawlen(L, -1);
+		for (i=0;i<n;i++) {
+			lua_geti(L, -1, i+1);
+			program_output_register(L, P, -1);
+			lua_pop(L, 1);
+		}
+		break; }
+	default:
+		program_output_register(L, P, -1);
+		break;
+	}
+	lua_pop(L, 1);
+}
+
+// upvalue 1 : LS
+// upvalue 2 : program metatable
+// math3d.program {
+//	input = "mvqn",	-- types of input registers 1..n : matrix, vector, quat, number
+//	{ "mul", 1, 2 },	-- each instruction writes a new register (n+1, n+2, ...)
+//	...
+//	output = { 5, 6 },	-- output registers, default is the last one
+// }
+static int
+lprogram(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_settop(L, 1);
+	struct program *P = lua_newuserdatauv(L, sizeof(struct program), 0);
+	program_compile(L, P, 1);
+	lua_pushvalue(L, lua_upvalueindex(2));
+	lua_setmetatable(L, -2);
+	return 1;
+}
+
+static struct program *
+check_program(lua_State *L, int index) {
+	if (lua_getmetatable(L, index)) {
+		int eq = lua_rawequal(L, -1, lua_upvalueindex(2));
+		lua_pop(L, 1);
+		if (eq)
+			return (struct program *)lua_touserdata(L, index);
+	}
+	luaL_argerror(L, index, "Need a program");
+	return NULL;
+}
+
+static const float *
+program_input(lua_State *L, struct lastack *LS, int index, int type, float num[4]) {
+	switch (type) {
+	case LINEAR_TYPE_MAT:
+		return matrix_from_index(L, LS, index);
+	case LINEAR_TYPE_VEC4:
+		return vector_from_index(L, LS, index);
+	case LINEAR_TYPE_QUAT:
+		return quat_from_index(L, LS, index);
+	default:
+		if (lua_type(L, index) != LUA_TNUMBER)
+			luaL_error(L, "Need a number for program input");
+		num[0] = lua_tonumber(L, index);
+		return num;
+	}
+}
+
+static void
+program_output(lua_State *L, struct lastack *LS, const float *v, int type) {
+	if (type == LINEAR_TYPE_NUM) {
+		lua_pushnumber(L, v[0]);
+	} else {
+		lastack_pushobject(LS, v, type);
+		lua_pushlightuserdata(L, STACKID(lastack_pop(LS)));
+	}
+}
+
+// program(inputs...) returns outputs
+static int
+lprogram_call(lua_State *L) {
+	struct program *P = check_program(L, 1);
+	struct lastack *LS = GETLS(L);
+	const float *reg[PROGRAM_MAXREG];
+	float num[PROGRAM_MAXREG][4];
+	float result[PROGRAM_MAXREG][16];
+	int i;
+	for (i=0;i<P->ninput;i++) {
+		reg[i] = program_input(L, LS, i+2, P->type[i], num[i]);
+	}
+	math3d_program_exec(P->code, P->ncode, reg, P->ninput, result);
+	luaL_checkstack(L, P->noutput, NULL);
+	for (i=0;i<P->noutput;i++) {
+		int r = P->output[i];
+		program_output(L, LS, reg[r], P->type[r]);
+	}
+	return P->noutput;
+}
+
+// program:batch(n, inputs... [, outputs...])
+// An input is a table of n values, or one value shared by all n runs.
+// Outputs are tables filled with n results, new tables are created when omitted.
+static int
+lprogram_batch(lua_State *L) {
+	struct program *P = check_program(L, 1);
+	struct lastack *LS = GETLS(L);
+	const int n = (int)luaL_checkinteger(L, 2);
+	const int in = 3;
+	const int out = in + P->ninput;
+	const float *reg[PROGRAM_MAXREG];
+	float num[PROGRAM_MAXREG][4];
+	float result[PROGRAM_MAXREG][16];
+	uint8_t list[PROGRAM_MAXREG];
+	int i, j;
+	for (j=0;j<P->ninput;j++) {
+		const int index = in + j;
+		list[j] = 0;
+		if (lua_type(L, index) == LUA_TTABLE) {
+			if (P->type[j] == LINEAR_TYPE_NUM) {
+				list[j] = 1;
+			} else if (lua_rawlen(L, index) > 0) {
+				// a number at [1] means the table is a value
+				list[j] = (lua_geti(L, index, 1) != LUA_TNUMBER);
+				lua_pop(L, 1);
+			}
+		}
+		if (!list[j])
+			reg[j] = program_input(L, LS, index, P->type[j], num[j]);
+	}
+	luaL_checkstack(L, P->noutput, NULL);
+	lua_settop(L, out + P->noutput - 1);
+	for (j=0;j<P->noutput;j++) {
+		const int index = out + j;
+		if (lua_isnil(L, index)) {
+			lua_createtable(L, n, 0);
+			lua_replace(L, index);
+		} else {
+			luaL_checktype(L, index, LUA_TTABLE);
+		}
+	}
+	uint64_t trace_t = MATH3D_TRACE_BEGIN();
+	for (i=1;i<=n;i++) {
+		for (j=0;j<P->ninput;j++) {
+			if (list[j]) {
+				lua_geti(L, in + j, i);
+				reg[j] = program_input(L, LS, -1, P->type[j], num[j]);
+				lua_pop(L, 1);
+			}
+		}
+		math3d_program_exec(P->code, P->ncode, reg, P->ninput, result);
+		for (j=0;j<P->noutput;j++) {
+			int r = P->output[j];
+			program_output(L, LS, reg[r], P->type[r]);
+			lua_seti(L, out + j, i);
+		}
+	}
+	MATH3D_TRACE_END("program_batch", trace_t, n);
+	return P->noutput;
+}
+
+// alloc report : sample the lua source line of every interval temps
+
+#define ALLOC_SITE_MAX 256
+
+struct alloc_site {
+	char source[LUA_IDSIZE];
+	int line;
+	uint64_t count;
+	uint64_t bytes;
+};
+
+struct alloc_sampler {
+	int interval;
+	int n;
+	uint64_t overflow;
+	struct alloc_site site[ALLOC_SITE_MAX];
+};
+
+// the caller of the sampler may be a coroutine, keep it in registry so that it's alive when sampled
+void
+math3d_keepcaller(lua_State *L) {
+	lua_pushthread(L);
+	lua_setfield(L, LUA_REGISTRYINDEX, "MATH3D_CALLER");
+}
+
+static void
+alloc_sample(void *ud, void *caller, int size) {
+	struct alloc_sampler *S = (struct alloc_sampler *)ud;
+	lua_State *L = (lua_State *)caller;
+	lua_Debug ar;
+	int level;
+	if (L == NULL)
+		return;
+	ar.currentline = -1;
+	// the first lua function in the call stack
+	for (level = 1; lua_getstack(L, level, &ar); level++) {
+		lua_getinfo(L, "Sl", &ar);
+		if (ar.currentline >= 0)
+			break;
+	}
+	if (ar.currentline < 0)
+		return;
+	uint32_t h = (uint32_t)ar.currentline * 2654435761u;
+	const char *src = ar.short_src;
+	for (; *src; src++) {
+		h = (h ^ (unsigned char)*src) * 16777619u;
+	}
+	int i;
+	for (i=0;i<ALLOC_SITE_MAX;i++) {
+		struct alloc_site *site = &S->site[(h + i) % ALLOC_SITE_MAX];
+		if (site->count == 0) {
+			if (S->n >= ALLOC_SITE_MAX / 4 * 3)
+				break;
+			++S->n;
+			memcpy(site->source, ar.short_src, sizeof(site->source));
+			site->line = ar.currentline;
+		} else if (site->line != ar.currentline || strcmp(site->source, ar.short_src) != 0) {
+			continue;
+		}
+		++site->count;
+		site->bytes += size;
+		return;
+	}
+	++S->overflow;
+}
+
+static int
+alloc_site_compare(const void *a, const void *b) {
+	const struct alloc_site *sa = *(const struct alloc_site **)a;
+	const struct alloc_site *sb = *(const struct alloc_site **)b;
+	if (sa->count != sb->count)
+		return sa->count < sb->count ? 1 : -1;
+	return 0;
+}
+
+// math3d.alloc_report(interval) : sample every interval temps (clear the report), 0 to stop
+// math3d.alloc_report() returns { { source = , line = , count = , bytes = } ... } sorted by count, the numbers are estimated (samples * interval)
+static int
+lalloc_report(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	struct alloc_sampler *S = NULL;
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "MATH3D_ALLOC") == LUA_TUSERDATA)
+		S = (struct alloc_sampler *)lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	if (!lua_isnoneornil(L, 1)) {
+		int interval = (int)luaL_checkinteger(L, 1);
+		lua_pushnil(L);
+		lua_setfield(L, LUA_REGISTRYINDEX, "MATH3D_CALLER");
+		if (interval <= 0) {
+			lastack_sample(LS, NULL, NULL, 0);
+			return 0;
+		}
+		if (S == NULL) {
+			S = (struct alloc_sampler *)lua_newuserdatauv(L, sizeof(*S), 0);
+			lua_setfield(L, LUA_REGISTRYINDEX, "MATH3D_ALLOC");
+		}
+		memset(S, 0, sizeof(*S));
+		S->interval = interval;
+		lastack_sample(LS, alloc_sample, S, interval);
+		return 0;
+	}
+	if (S == NULL)
+		return 0;
+	const struct alloc_site *sites[ALLOC_SITE_MAX];
+	int i, n = 0;
+	for (i=0;i<ALLOC_SITE_MAX;i++) {
+		if (S->site[i].count > 0)
+			sites[n++] = &S->site[i];
+	}
+	qsort(sites, n, sizeof(sites[0]), alloc_site_compare);
+	lua_createtable(L, n, 1);
+	for (i=0;i<n;i++) {
+		lua_createtable(L, 0, 4);
+		lua_pushstring(L, sites[i]->source);
+		lua_setfield(L, -2, "source");
+		lua_pushinteger(L, sites[i]->line);
+		lua_setfield(L, -2, "line");
+		lua_pushinteger(L, (lua_Integer)(sites[i]->count * S->interval));
+		lua_setfield(L, -2, "count");
+		lua_pushinteger(L, (lua_Integer)(sites[i]->bytes * S->interval));
+		lua_setfield(L, -2, "bytes");
+		lua_rawseti(L, -2, i+1);
+	}
+	lua_pushinteger(L, (lua_Integer)(S->overflow * S->interval));
+	lua_setfield(L, -2, "overflow");
+	return 1;
+}
+
+// math3d.trace(capacity) : record chrome trace events (batch ops, serialize, stack growth and reset) into a ring of capacity events
+// math3d.trace(false) or math3d.trace(0) : stop
+static int
+ltrace(lua_State *L) {
+	int capacity = lua_toboolean(L, 1) ? (int)luaL_checkinteger(L, 1) : 0;
+	if (capacity <= 0) {
+		math3d_trace_stop();
+		return 0;
+	}
+	if (!math3d_trace_start(capacity))
+		return luaL_error(L, "Can't allocate trace buffer of %d events", capacity);
+	return 0;
+}
+
+// math3d.trace_dump(filename) : write the events recorded as chrome trace json, returns the number of events
+static int
+ltrace_dump(lua_State *L) {
+	const char *filename = luaL_checkstring(L, 1);
+	int n = math3d_trace_dump(filename);
+	if (n < 0)
+		return luaL_error(L, "Can't write trace to %s", filename);
+	lua_pushinteger(L, n);
+	return 1;
+}
+
+// profile : build with MATH3D_PROFILE, every function in math3d (ref, refarray, program and deserialize included),
+// and the methods of ref, array, refarray and program are wrapped by lprofile_call.
+// math3d.profile([reset]) returns { name = { count = , time = (ns), temps = } }, or nil without MATH3D_PROFILE
+
+#ifdef MATH3D_PROFILE
+
+#include "gettime.h"
+
+#define PROFILE_MAX 128
+#define PROFILE_UPVALUE 4	// the wrapped function has 3 upvalues at most
+
+struct profile_stat {
+	const char *prefix;
+	const char *name;
+	lua_CFunction func;
+	uint64_t count;
+	uint64_t time;
+	uint64_t temps;
+};
+
+struct profile {
+	int n;
+	struct profile_stat stat[PROFILE_MAX];
+};
+
+// upvalue 4 : profile_stat, upvalue 1-3 are the same as the wrapped function
+static int
+lprofile_call(lua_State *L) {
+	struct profile_stat *S = (struct profile_stat *)lua_touserdata(L, lua_upvalueindex(PROFILE_UPVALUE));
+	struct lastack *LS = GETLS(L);
+	int temps = lastack_temps(LS);
+	uint64_t t = gettime_ns();
+	int ret = S->func(L);
+	S->time += gettime_ns() - t;
+	++S->count;
+	temps = lastack_temps(LS) - temps;
+	if (temps > 0)
+		S->temps += temps;
+	return ret;
+}
+
+static struct profile *
+profile_new(lua_State *L) {
+	struct profile *P = lua_newuserdatauv(L, sizeof(*P), 0);
+	P->n = 0;
+	lua_setfield(L, LUA_REGISTRYINDEX, "MATH3D_PROFILE");
+	return P;
+}
+
+// the same as lua_pushcclosure, nup < PROFILE_UPVALUE
+static void
+profile_pushcclosure(lua_State *L, lua_CFunction f, int nup, struct profile *P, const char *prefix, const char *name) {
+	if (P->n >= PROFILE_MAX)
+		luaL_error(L, "Too many profile functions");
+	struct profile_stat *S = &P->stat[P->n++];
+	S->prefix = prefix;
+	S->name = name;
+	S->func = f;
+	S->count = S->time = S->temps = 0;
+	int i;
+	for (i=nup;i<PROFILE_UPVALUE-1;i++) {
+		lua_pushnil(L);
+	}
+	lua_pushlightuserdata(L, S);
+	lua_pushcclosure(L, lprofile_call, PROFILE_UPVALUE);
+}
+
+// the same as luaL_setfuncs
+static void
+profile_setfuncs(lua_State *L, const luaL_Reg *l, int nup, struct profile *P, const char *prefix) {
+	for (; l->name; l++) {
+		if (l->func == NULL) {
+			lua_pushboolean(L, 0);
+		} else {
+			int i;
+			for (i=0;i<nup;i++) {
+				lua_pushvalue(L, -nup);
+			}
+			profile_pushcclosure(L, l->func, nup, P, prefix, l->name);
+		}
+		lua_setfield(L, -(nup + 2), l->name);
+	}
+	lua_pop(L, nup);
+}
+
+#define SETFUNCS(L, l, nup, P, prefix) profile_setfuncs(L, l, nup, P, prefix)
+#define PUSHCCLOSURE(L, f, nup, P, name) profile_pushcclosure(L, f, nup, P, "", name)
+
+static int
+lprofile(lua_State *L) {
+	int reset = lua_toboolean(L, 1);
+	if (lua_getfield(L, LUA_REGISTRYINDEX, "MATH3D_PROFILE") != LUA_TUSERDATA)
+		return luaL_error(L, "No profile data");
+	struct profile *P = lua_touserdata(L, -1);
+	lua_newtable(L);
+	int i;
+	for (i=0;i<P->n;i++) {
+		struct profile_stat *S = &P->stat[i];
+		if (S->count > 0) {
+			lua_pushfstring(L, "%s%s", S->prefix, S->name);
+			lua_createtable(L, 0, 3);
+			lua_pushinteger(L, (lua_Integer)S->count);
+			lua_setfield(L, -2, "count");
+			lua_pushinteger(L, (lua_Integer)S->time);
+			lua_setfield(L, -2, "time");
+			lua_pushinteger(L, (lua_Integer)S->temps);
+			lua_setfield(L, -2, "temps");
+			lua_settable(L, -3);
+		}
+		if (reset)
+			S->count = S->time = S->temps = 0;
+	}
+	return 1;
+}
+
+#else
+
+#define SETFUNCS(L, l, nup, P, prefix) luaL_setfuncs(L, l, nup)
+#define PUSHCCLOSURE(L, f, nup, P, name) lua_pushcclosure(L, f, nup)
+
+static int
+lprofile(lua_State *L) {
+	return 0;
+}
+
+#endif
+
 LUAMOD_API int
 luaopen_math3d(lua_State *L) {
 	luaL_checkversion(L);
 
 	struct boxstack * bs = lua_newuserdatauv(L, sizeof(struct boxstack), 0);
 	bs->LS = lastack_new();
+	bs->api = math3d_api();
 	finalize(L, boxstack_gc);
 	lua_setfield(L, LUA_REGISTRYINDEX, MATH3D_STACK);
+#ifdef MATH3D_PROFILE
+	struct profile *P = profile_new(L);
+#endif
 
 	luaL_Reg l[] = {
 		{ "ref", NULL },
+		{ "refarray", NULL },
+		{ "program", NULL },
+		{ "array", larray },
+		{ "view", lview },
+		{ "serialize", lserialize },
+		{ "deserialize", NULL },
+		{ "transform_array", ltransform_array },
+		{ "dualquat_array", ldualquat_array },
 		{ "tostring", ltostring },
 		{ "matrix", lmatrix },
+		{ "affine", laffine },
+		{ "dualquat", ldualquat },
 		{ "vector", lvector },
 		{ "quaternion", lquaternion },
 		{ "index", lindex },
@@ -1268,6 +3310,9 @@ luaopen_math3d(lua_State *L) {
 		{ "sub", lsub },
 		{ "muladd", lmuladd},
 		{ "srt", lsrt },
+		{ "srt_array", lsrt_array },
+		{ "normal_array", lnormal_array },
+		{ "rebase_array", lrebase_array },
 		{ "length", llength },
 		{ "floor", lfloor },
 		{ "ceil", lceil },
@@ -1282,6 +3327,7 @@ luaopen_math3d(lua_State *L) {
 		{ "todirection", ltodirection },
 		{ "torotation", ltorotation },
 		{ "totable", ltotable},
+		{ "unpack", lunpack},
 		{ "base_axes", lbase_axes},
 		{ "transform", ltransform},
 		{ "transformH", ltransform_homogeneous_point },
@@ -1291,13 +3337,38 @@ luaopen_math3d(lua_State *L) {
 		{ "dir2radian", ldir2radian},
 		{ "stacksize", lstacksize},
 		{ "homogeneous_depth", lhomogeneous_depth },
-		{ "pack", lpack },
+		{ "precision", lprecision },
+		{ "profile", NULL },
+		{ "alloc_report", lalloc_report },
+		{ "trace", ltrace },
+		{ "trace_dump", ltrace_dump },
 		{ NULL, NULL },
 	};
 
+	luaL_Reg array_mt[] = {
+		{ "__index", larray_index },
+		{ "__newindex", larray_newindex },
+		{ "__len", larray_len },
+		{ "__tostring", larray_tostring },
+		{ "__gc", larray_gc },
+		{ "fill", larray_fill },
+		{ "copy", larray_copy },
+		{ "pointer", larray_pointer },
+		{ NULL, NULL },
+	};
+
+	luaL_newlibtable(L, array_mt);
+	lua_pushlightuserdata(L, bs->LS);
+	lua_pushvalue(L, -2);
+	SETFUNCS(L, array_mt, 2, P, "array.");
+	const int array_metatable = lua_gettop(L);
+
 	luaL_newlibtable(L,l);
 	lua_pushlightuserdata(L, bs->LS);
-	luaL_setfuncs(L,l,1);
+	lua_pushvalue(L, array_metatable);
+	SETFUNCS(L,l,2,P,"");
+	lua_pushcfunction(L, lprofile);
+	lua_setfield(L, -2, "profile");
 
 	luaL_Reg ref_mt[] = {
 		{ "__newindex", lref_setter },
@@ -1311,11 +3382,56 @@ luaopen_math3d(lua_State *L) {
 
 	luaL_newlibtable(L,ref_mt);
 	lua_pushlightuserdata(L, bs->LS);
-	luaL_setfuncs(L,ref_mt,1);
+	SETFUNCS(L,ref_mt,1,P,"ref.");
+
+	lua_pushlightuserdata(L, bs->LS);
+	lua_pushvalue(L, array_metatable);
+	lua_pushvalue(L, -3);	// ref metatable
+	PUSHCCLOSURE(L, ldeserialize, 3, P, "deserialize");
+	lua_setfield(L, -4, "deserialize");
 
-	lua_pushcclosure(L, lref, 2);
+	PUSHCCLOSURE(L, lref, 2, P, "ref");
 	lua_setfield(L, -2, "ref");
 
+	luaL_Reg refarray_mt[] = {
+		{ "__index", lrefarray_index },
+		{ "__newindex", lrefarray_newindex },
+		{ "__len", lrefarray_len },
+		{ "__tostring", lrefarray_tostring },
+		{ "__gc", lrefarray_gc },
+		{ "get", lrefarray_get },
+		{ "set", lrefarray_set },
+		{ NULL, NULL },
+	};
+
+	lua_pushlightuserdata(L, bs->LS);
+
+	luaL_newlibtable(L, refarray_mt);
+	lua_pushlightuserdata(L, bs->LS);
+	lua_pushvalue(L, -2);
+	SETFUNCS(L, refarray_mt, 2, P, "refarray.");
+
+	PUSHCCLOSURE(L, lrefarray, 2, P, "refarray");
+	lua_setfield(L, -2, "refarray");
+
+	luaL_Reg program_mt[] = {
+		{ "__call", lprogram_call },
+		{ "batch", lprogram_batch },
+		{ NULL, NULL },
+	};
+
+	lua_pushlightuserdata(L, bs->LS);
+
+	luaL_newlibtable(L, program_mt);
+	lua_pushlightuserdata(L, bs->LS);
+	lua_pushvalue(L, -2);
+	SETFUNCS(L, program_mt, 2, P, "program.");
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+
+	PUSHCCLOSURE(L, lprogram, 2, P, "program");
+	lua_setfield(L, -2, "program");
+
 	return 1;
 }
 
@@ -1323,6 +3439,7 @@ luaopen_math3d(lua_State *L) {
 
 const float *
 math3d_from_lua(lua_State *L, struct lastack *LS, int index, int type) {
+	math3d_setcaller(L, LS);
 	switch(type) {
 	case LINEAR_TYPE_MAT:
 		return matrix_from_index(L, LS, index);
@@ -1330,6 +3447,10 @@ math3d_from_lua(lua_State *L, struct lastack *LS, int index, int type) {
 		return vector_from_index(L, LS, index);
 	case LINEAR_TYPE_QUAT:
 		return quat_from_index(L, LS, index);
+	case LINEAR_TYPE_AFFINE:
+		return object_from_index(L, LS, index, LINEAR_TYPE_AFFINE, affine_from_table);
+	case LINEAR_TYPE_DUALQUAT:
+		return object_from_index(L, LS, index, LINEAR_TYPE_DUALQUAT, dualquat_from_table);
 	default:
 		luaL_error(L, "Invalid math3d object type %d", type);
 	}
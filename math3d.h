@@ -2,10 +2,12 @@
 #define math3d_lua_binding_h
 
 #include "linalg.h"
+#include "math3dapi.h"
 #include <lua.h>
 
 struct boxstack {
 	struct lastack *LS;	
+	const struct math3d_api *api;
 };
 
 struct refobject {
@@ -20,5 +22,13 @@ int math3d_homogeneous_depth();
 
 const float * math3d_from_lua(lua_State *L, struct lastack *LS, int index, int type);
 const float * math3d_from_lua_id(lua_State *L, struct lastack *LS, int index, int *type);
+void math3d_keepcaller(lua_State *L);
+
+// record the lua thread for the alloc sampler, the thread is kept alive while it's the caller
+static inline void
+math3d_setcaller(lua_State *L, struct lastack *LS) {
+	if (lastack_setcaller(LS, L))
+		math3d_keepcaller(L);
+}
 
 #endif
@@ -0,0 +1,97 @@
+#include "math3dapi.h"
+
+#define AM LINEAR_TYPE_MAT
+#define AV LINEAR_TYPE_VEC4
+#define AQ LINEAR_TYPE_QUAT
+#define AN LINEAR_TYPE_NUM
+
+// number is stored in a vec4
+#define STORAGE(t) ((t) == AN ? AV : (t))
+
+static const struct opsig {
+	int result;
+	int n;	// required arguments
+	int opt;	// optional arguments
+	int arg[3];
+} op_signature[] = {
+	[MATH3D_OP_MUL_MAT] = { AM, 2, 0, { AM, AM } },
+	[MATH3D_OP_MUL_QUAT] = { AQ, 2, 0, { AQ, AQ } },
+	[MATH3D_OP_MUL_VEC] = { AV, 2, 0, { AV, AV } },
+	[MATH3D_OP_SCALE_VEC] = { AV, 2, 0, { AV, AN } },
+	[MATH3D_OP_ADD] = { AV, 2, 0, { AV, AV } },
+	[MATH3D_OP_SUB] = { AV, 2, 0, { AV, AV } },
+	[MATH3D_OP_TRANSFORM_QUAT] = { AV, 2, 0, { AQ, AV } },
+	[MATH3D_OP_TRANSFORM_MAT] = { AV, 2, 0, { AM, AV } },
+	[MATH3D_OP_TRANSFORMH] = { AV, 2, 0, { AM, AV } },
+	[MATH3D_OP_INVERSE_MAT] = { AM, 1, 0, { AM } },
+	[MATH3D_OP_INVERSE_QUAT] = { AQ, 1, 0, { AQ } },
+	[MATH3D_OP_INVERSE_VEC] = { AV, 1, 0, { AV } },
+	[MATH3D_OP_TRANSPOSE] = { AM, 1, 0, { AM } },
+	[MATH3D_OP_NORMALIZE_VEC] = { AV, 1, 0, { AV } },
+	[MATH3D_OP_NORMALIZE_QUAT] = { AQ, 1, 0, { AQ } },
+	[MATH3D_OP_LOOKAT] = { AM, 2, 1, { AV, AV, AV } },
+	[MATH3D_OP_LOOKTO] = { AM, 2, 1, { AV, AV, AV } },
+	[MATH3D_OP_QUAT_TO_MAT] = { AM, 1, 0, { AQ } },
+	[MATH3D_OP_MAT_TO_QUAT] = { AQ, 1, 0, { AM } },
+	[MATH3D_OP_SRT] = { AM, 3, 0, { AV, AQ, AV } },
+	[MATH3D_OP_CROSS] = { AV, 2, 0, { AV, AV } },
+	[MATH3D_OP_DOT] = { AN, 2, 0, { AV, AV } },
+	[MATH3D_OP_LENGTH] = { AN, 1, 0, { AV } },
+	[MATH3D_OP_LERP] = { AV, 3, 0, { AV, AV, AN } },
+	[MATH3D_OP_RECIPROCAL] = { AV, 1, 0, { AV } },
+	[MATH3D_OP_TODIRECTION_QUAT] = { AV, 1, 0, { AQ } },
+	[MATH3D_OP_TODIRECTION_MAT] = { AV, 1, 0, { AM } },
+};
+
+#define OP_COUNT (sizeof(op_signature)/sizeof(op_signature[0]))
+
+static int64_t
+api_push(struct lastack *LS, const float *v, int type) {
+	if (type < 0 || type >= LINEAR_TYPE_COUNT)
+		return 0;
+	lastack_setcaller(LS, NULL);	// no lua context for alloc sampling
+	lastack_pushobject(LS, v, type);
+	return lastack_pop(LS);
+}
+
+static int64_t
+api_op(struct lastack *LS, int opcode, int64_t a, int64_t b, int64_t c) {
+	if (opcode < 0 || opcode >= (int)OP_COUNT)
+		return 0;
+	const struct opsig *sig = &op_signature[opcode];
+	const int64_t id[3] = { a, b, c };
+	const float *reg[3 + 1];
+	float result[1][16];
+	struct math3d_instruction inst = { (uint8_t)opcode, { 0, 0, MATH3D_NOARG } };
+	int i;
+	for (i=0;i<sig->n + sig->opt;i++) {
+		if (i >= sig->n && id[i] == 0)
+			continue;
+		int type;
+		reg[i] = lastack_value(LS, id[i], &type);
+		if (reg[i] == NULL || type != STORAGE(sig->arg[i]))
+			return 0;
+		inst.arg[i] = i;
+	}
+	math3d_program_exec(&inst, 1, reg, 3, result);
+	if (sig->result == AN) {
+		float v[4] = { result[0][0], 0, 0, 0 };
+		return api_push(LS, v, LINEAR_TYPE_VEC4);
+	}
+	return api_push(LS, result[0], sig->result);
+}
+
+static const struct math3d_api api = {
+	MATH3D_API_VERSION,
+	api_push,
+	lastack_value,
+	lastack_mark,
+	lastack_unmark,
+	lastack_constant,
+	api_op,
+};
+
+const struct math3d_api *
+math3d_api() {
+	return &api;
+}
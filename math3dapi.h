@@ -0,0 +1,39 @@
+#ifndef math3d_api_h
+#define math3d_api_h
+
+// Public C API for native modules sharing the math3d stack.
+// Get it from the registry : ((struct boxstack *)registry[MATH3D_STACK])->api , see math3d.h
+// All functions work on the lastack of the lua state (boxstack->LS), they are not thread safe.
+// Temp ids are valid until math3d.reset() , use mark/unmark to keep values across frames.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "linalg.h"
+#include "math3dfunc.h"
+
+#define MATH3D_API_VERSION 1
+
+struct math3d_api {
+	int version;	// MATH3D_API_VERSION, fields are only appended in later versions
+	int64_t (*push)(struct lastack *LS, const float *v, int type);	// returns a temp id
+	const float * (*value)(struct lastack *LS, int64_t id, int *type);	// NULL if id is invalid
+	int64_t (*mark)(struct lastack *LS, int64_t id);	// returns a persistent id, 0 if id is invalid
+	void (*unmark)(struct lastack *LS, int64_t markid);
+	int64_t (*constant)(int type);	// identity value of type
+	// run one math3d_opcode, unused arguments are 0 (the optional up of lookat/lookto too).
+	// number arguments and results are the x of a vec4.
+	// returns a temp id, 0 if the arguments mismatch.
+	int64_t (*op)(struct lastack *LS, int opcode, int64_t a, int64_t b, int64_t c);
+};
+
+const struct math3d_api * math3d_api();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
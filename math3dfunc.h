@@ -14,11 +14,13 @@ int math3d_mul_object(struct lastack *LS, const float *lval, const float *rval,
 void math3d_add_vec(struct lastack *LS, const float lhs[4], const float rhs[4], float r[4]);
 void math3d_sub_vec(struct lastack *LS, const float lhs[4], const float rhs[4], float r[4]);
 void math3d_decompose_matrix(struct lastack *LS, const float *mat);
+void math3d_decompose_matrix_array(const float *mat, int n, float *scale, float *rot, float *trans);
 void math3d_decompose_rot(const float mat[16], float quat[4]);
 int math3d_decompose_scale(const float mat[16], float scale[4]);
 void math3d_quat_to_matrix(struct lastack *LS, const float quat[4]);
 void math3d_matrix_to_quat(struct lastack *LS, const float mat[16]);
 float math3d_length(const float *v3);
+float math3d_length_fast(const float *v3);
 void math3d_floor(struct lastack *LS, const float v[4]);
 void math3d_ceil(struct lastack *LS, const float v[4]);
 float math3d_dot(const float v1[4], const float v2[4]);
@@ -26,20 +28,94 @@ void math3d_cross(struct lastack *LS, const float v1[4], const float v2[4]);
 void math3d_mulH(struct lastack *LS, const float mat[16], const float vec[4]);
 void math3d_normalize_vector(struct lastack *LS, const float v[4]);
 void math3d_normalize_quat(struct lastack *LS, const float v[4]);
+void math3d_normalize_vector_fast(struct lastack *LS, const float v[4]);
+void math3d_normalize_quat_fast(struct lastack *LS, const float v[4]);
 void math3d_inverse_matrix(struct lastack *LS, const float mat[16]);
+void math3d_inverse_affine(struct lastack *LS, const float m[12]);
+void math3d_affine_transform(struct lastack *LS, const float m[12], const float v[4]);	// m * v, v.w is the weight of the translation
+void math3d_affine_to_matrix(const float m[12], float r[16]);
+void math3d_matrix_to_affine(const float m[16], float r[12]);	// drop the last row
+void math3d_normal_matrix_array(const float *mat, int n, float *out, int stride);	// stride : 9 (3x3) or 12 (3x4)
 void math3d_inverse_quat(struct lastack *LS, const float quat[4]);
 void math3d_transpose_matrix(struct lastack *LS, const float mat[16]);
 void math3d_lookat_matrix(struct lastack *LS, int direction, const float eye[3], const float at[3], const float *up);
 void math3d_reciprocal(struct lastack *LS, const float v[4]);
+void math3d_reciprocal_fast(struct lastack *LS, const float v[4]);
 void math3d_quat_to_viewdir(struct lastack *LS, const float q[4]);
 void math3d_rotmat_to_viewdir(struct lastack *LS, const float m[16]);
 void math3d_viewdir_to_quat(struct lastack *LS, const float v[3]);
 void math3d_frustumLH(struct lastack *LS, float left, float right, float bottom, float top, float near, float far, int homogeneous_depth);
 void math3d_orthoLH(struct lastack *LS, float left, float right, float bottom, float top, float near, float far, int homogeneous_depth);
-void math3d_base_axes(struct lastack *LS, const float forward[4]);
+void math3d_base_axes(const float forward[4], float right[4], float up[4]);
 void math3d_quat_transform(struct lastack *LS, const float quat[4], const float v[4]);
 void math3d_rotmat_transform(struct lastack *LS, const float mat[16], const float v[4]);
 void math3d_minmax(struct lastack *LS, const float mat[16], const float v[4], float minv[4], float maxv[4]);
+void math3d_minmax_array(const float mat[16], const float *v, int stride, int n, float minv[4], float maxv[4]);	// stride in floats, mat can be NULL
+void math3d_transform_array(const float mat[16], const float *v, int vstride, int n, const float *w, float *out, int ostride);	// replace v.w with *w if w isn't NULL, out can be v
+// dual quaternion : rigid transforms only, the scale of matrices is dropped
+void math3d_make_dualquat(struct lastack *LS, const float r[4], const float t[3]);	// r, t can be NULL
+void math3d_matrix_to_dualquat(struct lastack *LS, const float mat[16]);
+void math3d_dualquat_to_matrix(struct lastack *LS, const float dq[8]);
+void math3d_decompose_dualquat(struct lastack *LS, const float dq[8]);	// push t, r, s (1) as math3d_decompose_matrix
+void math3d_normalize_dualquat(struct lastack *LS, const float dq[8]);
+void math3d_inverse_dualquat(struct lastack *LS, const float dq[8]);	// dq should be normalized
+void math3d_dualquat_transform(struct lastack *LS, const float dq[8], const float v[4]);	// v.w is the weight of the translation
+void math3d_dualquat_transform_array(const float dq[8], const float *v, int vstride, int n, const float *w, float *out, int ostride);	// the same as math3d_transform_array
+void math3d_dualquat_array(const float *mats, int n, float *out, int stride);	// skinning palette from n matrices, stride in floats
 void math3d_lerp(struct lastack *LS, const float v0[4], const float v1[4], float ratio, float r[4]);
 void math3d_dir2radian(struct lastack *LS, const float v[4], float radians[2]);
+
+// double precision, see math3d.double. r can be the same as the input
+
+void math3d_mul_dmat(const double a[16], const double b[16], double r[16]);
+void math3d_transform_dvec(const double mat[16], const double v[4], double r[4]);
+void math3d_inverse_dmat(const double mat[16], double r[16]);
+void math3d_rebase_dmat(const double mat[16], const double origin[3], float r[16]);	// translate by -origin in double, origin can be NULL
+// camera relative world (and view * world) matrices of affine world matrices, world or worldview can be NULL. strides are in floats
+// the translation of mats[i] is the high part, low[i] (can be NULL) is the low part
+void math3d_rebase_array(const float *mats, const float *low, int lstride, int n, const double origin[3], const float view[16], float *world, int wstride, float *worldview, int wvstride);
+// mats can be unaligned
+void math3d_rebase_dmat_array(const double *mats, int n, const double origin[3], const float view[16], float *world, int wstride, float *worldview, int wvstride);
+
+// program : a list of instructions over registers, see math3d.program
+
+#define MATH3D_NOARG 0xff
+
+enum math3d_opcode {
+	MATH3D_OP_MUL_MAT,	// mat * mat
+	MATH3D_OP_MUL_QUAT,	// quat * quat
+	MATH3D_OP_MUL_VEC,	// vec4 * vec4
+	MATH3D_OP_SCALE_VEC,	// vec4 * number
+	MATH3D_OP_ADD,
+	MATH3D_OP_SUB,
+	MATH3D_OP_TRANSFORM_QUAT,
+	MATH3D_OP_TRANSFORM_MAT,
+	MATH3D_OP_TRANSFORMH,
+	MATH3D_OP_INVERSE_MAT,
+	MATH3D_OP_INVERSE_QUAT,
+	MATH3D_OP_INVERSE_VEC,
+	MATH3D_OP_TRANSPOSE,
+	MATH3D_OP_NORMALIZE_VEC,
+	MATH3D_OP_NORMALIZE_QUAT,
+	MATH3D_OP_LOOKAT,	// eye, at [, up]
+	MATH3D_OP_LOOKTO,	// eye, direction [, up]
+	MATH3D_OP_QUAT_TO_MAT,
+	MATH3D_OP_MAT_TO_QUAT,
+	MATH3D_OP_SRT,	// s, r, t
+	MATH3D_OP_CROSS,
+	MATH3D_OP_DOT,
+	MATH3D_OP_LENGTH,
+	MATH3D_OP_LERP,	// v0, v1, ratio
+	MATH3D_OP_RECIPROCAL,
+	MATH3D_OP_TODIRECTION_QUAT,
+	MATH3D_OP_TODIRECTION_MAT,
+};
+
+struct math3d_instruction {
+	uint8_t op;
+	uint8_t arg[3];	// register index, unused is 0. the optional 3rd argument can be MATH3D_NOARG
+};
+
+// reg[0, base) are inputs, the result of code[i] is written into result[i] and reg[base+i]
+void math3d_program_exec(const struct math3d_instruction *code, int n, const float **reg, int base, float (*result)[16]);
 #endif
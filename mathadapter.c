@@ -3,6 +3,7 @@
 #include <lua.h>
 #include <lauxlib.h>
 #include <stdint.h>
+#include <string.h>
 #include "math3d.h"
 #include "linalg.h"
 
@@ -13,6 +14,13 @@ typedef enum {
 	SET_Unknown,
 }StackElemType;
 
+static inline struct lastack *
+GETLS(lua_State *L) {
+	struct lastack *LS = (struct lastack *)lua_touserdata(L, lua_upvalueindex(1));
+	math3d_setcaller(L, LS);
+	return LS;
+}
+
 static inline void *
 get_pointer(lua_State *L, struct lastack *LS, int index, int type) {
 	return (void *)math3d_from_lua(L, LS, index, type);
@@ -41,7 +49,7 @@ get_pointer_variant(lua_State *L, struct lastack *LS, int index, int elemtype) {
 // upvalue3  from
 static int
 lmatrix_adapter_1(lua_State *L) {
-	struct lastack *LS = lua_touserdata(L, lua_upvalueindex(1));
+	struct lastack *LS = GETLS(L);
 	lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
 	int from = lua_tointeger(L, lua_upvalueindex(3));
 	void * v = get_pointer(L, LS, from, LINEAR_TYPE_MAT);
@@ -52,7 +60,7 @@ lmatrix_adapter_1(lua_State *L) {
 
 static int
 lmatrix_adapter_2(lua_State *L) {
-	struct lastack *LS = lua_touserdata(L, lua_upvalueindex(1));
+	struct lastack *LS = GETLS(L);
 	lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
 	int from = lua_tointeger(L, lua_upvalueindex(3));
 	void * v1 = getopt_pointer(L, LS, from, LINEAR_TYPE_MAT);
@@ -73,7 +81,7 @@ lmatrix_adapter_2(lua_State *L) {
 
 static int
 lmatrix_adapter_var(lua_State *L) {
-	struct lastack *LS = lua_touserdata(L, lua_upvalueindex(1));
+	struct lastack *LS = GETLS(L);
 	lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
 	int from = lua_tointeger(L, lua_upvalueindex(3));
 	int i;
@@ -124,7 +132,7 @@ lbind_matrix(lua_State *L) {
 
 static int
 lvector(lua_State *L) {
-	struct lastack *LS = lua_touserdata(L, lua_upvalueindex(1));
+	struct lastack *LS = GETLS(L);
 	lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
 	const int from = lua_tointeger(L, lua_upvalueindex(3));
 
@@ -158,6 +166,12 @@ lbind_vector(lua_State *L) {
 	return 1;
 }
 
+// affine and dualquat are converted to a temp mat4 by the matrix function
+static inline uint8_t
+elem_settype(int type) {
+	return (type == LINEAR_TYPE_MAT || type == LINEAR_TYPE_AFFINE || type == LINEAR_TYPE_DUALQUAT) ? SET_Mat : SET_Vec;
+}
+
 static uint8_t
 check_elem_type(lua_State *L, struct lastack *LS, int index) {	
 	if (lua_type(L, index) == LUA_TTABLE) {
@@ -170,7 +184,7 @@ check_elem_type(lua_State *L, struct lastack *LS, int index) {
 				int type;
 				math3d_from_lua_id(L, LS, -1, &type);
 				lua_pop(L, 1);
-				return SET_Array | (type == LINEAR_TYPE_MAT ? SET_Mat : SET_Vec);
+				return SET_Array | elem_settype(type);
 			} 
 
 			lua_pop(L, 1);
@@ -181,7 +195,7 @@ check_elem_type(lua_State *L, struct lastack *LS, int index) {
 
 	int type;
 	math3d_from_lua_id(L, LS, index, &type);
-	return type == LINEAR_TYPE_MAT ? SET_Mat : SET_Vec;
+	return elem_settype(type);
 }
 
 static void
@@ -237,7 +251,7 @@ convert_stack_value(lua_State *L, struct lastack *LS, int from, int top, int ele
 // upvalue4 integer from
 static int
 lvariant(lua_State *L) {
-	struct lastack *LS = lua_touserdata(L, lua_upvalueindex(1));
+	struct lastack *LS = GETLS(L);
 	const int from = lua_tointeger(L, lua_upvalueindex(4));
 	const int top = lua_gettop(L);
 	const uint8_t elemtype = check_elem_type(L, LS, from);	
@@ -275,38 +289,109 @@ lbind_variant(lua_State *L) {
 	return 1;
 }
 
-static int
-lformat(lua_State *L, const char *format) {
-	struct lastack *LS = lua_touserdata(L, lua_upvalueindex(1));
-	lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
-	int from = lua_tointeger(L, lua_upvalueindex(4));
+#define FORMAT_MAX 32	// longer format strings raise an error
+
+// compiled format string
+struct format_desc {
+	int from;
+	int n;
+	uint8_t type[FORMAT_MAX];
+	char source[FORMAT_MAX+1];
+};
+
+static void
+format_compile(lua_State *L, struct format_desc *desc, const char *format) {
 	int i;
-	int top = lua_gettop(L);
-	void *v = NULL;
 	for (i=0;format[i];i++) {
-		int index = from + i;
-		if (index > top)
-			luaL_error(L, "Invalid format string %s", format);
+		if (i >= FORMAT_MAX)
+			luaL_error(L, "Format string %s is too long", format);
 		switch(format[i]) {
 		case 'm':
-			v = get_pointer(L, LS, index, LINEAR_TYPE_MAT);
+			desc->type[i] = LINEAR_TYPE_MAT;
 			break;
 		case 'v':
-			v = get_pointer(L, LS, index, LINEAR_TYPE_VEC4);
+			desc->type[i] = LINEAR_TYPE_VEC4;
 			break;
 		case 'q':
-			v = get_pointer(L, LS, index, LINEAR_TYPE_QUAT);
+			desc->type[i] = LINEAR_TYPE_QUAT;
+			break;
+		case 'a':
+			desc->type[i] = LINEAR_TYPE_AFFINE;
+			break;
+		case 'd':
+			desc->type[i] = LINEAR_TYPE_DUALQUAT;
 			break;
 		default:
 			luaL_error(L, "Invalid format string %s", format);
 			break;
 		}
-		lua_pushlightuserdata(L, v);
-		lua_replace(L, index);
+		desc->source[i] = format[i];
+	}
+	desc->source[i] = 0;
+	desc->n = i;
+}
+
+static inline const struct format_desc *
+format_check(lua_State *L) {
+	const struct format_desc *desc = (const struct format_desc *)lua_touserdata(L, lua_upvalueindex(5));
+	if (desc->from + desc->n - 1 > lua_gettop(L))
+		luaL_error(L, "Invalid format string %s", desc->source);
+	return desc;
+}
+
+static inline void
+format_arg(lua_State *L, struct lastack *LS, int index, int type) {
+	lua_pushlightuserdata(L, get_pointer(L, LS, index, type));
+	lua_replace(L, index);
+}
+
+static int
+lformat(lua_State *L, const struct format_desc *desc) {
+	struct lastack *LS = GETLS(L);
+	lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
+	int i;
+	for (i=0;i<desc->n;i++) {
+		format_arg(L, LS, desc->from + i, desc->type[i]);
 	}
 	return f(L);
 }
 
+static int
+lformat_1(lua_State *L) {
+	const struct format_desc *desc = format_check(L);
+	struct lastack *LS = GETLS(L);
+	lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
+	format_arg(L, LS, desc->from, desc->type[0]);
+	return f(L);
+}
+
+static int
+lformat_2(lua_State *L) {
+	const struct format_desc *desc = format_check(L);
+	struct lastack *LS = GETLS(L);
+	lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
+	format_arg(L, LS, desc->from, desc->type[0]);
+	format_arg(L, LS, desc->from+1, desc->type[1]);
+	return f(L);
+}
+
+static int
+lformat_3(lua_State *L) {
+	const struct format_desc *desc = format_check(L);
+	struct lastack *LS = GETLS(L);
+	lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
+	format_arg(L, LS, desc->from, desc->type[0]);
+	format_arg(L, LS, desc->from+1, desc->type[1]);
+	format_arg(L, LS, desc->from+2, desc->type[2]);
+	return f(L);
+}
+
+static int
+lformat_string(lua_State *L) {
+	return lformat(L, format_check(L));
+}
+
+// the format returned by C function is compiled again only when it changes
 static int
 lformat_function(lua_State *L) {
 	lua_CFunction getformat = lua_tocfunction(L, lua_upvalueindex(3));
@@ -314,19 +399,22 @@ lformat_function(lua_State *L) {
 		luaL_error(L, "Invalid format C function");
 	const char *format = (const char *)lua_touserdata(L, -1);
 	lua_pop(L, 1);
-	return lformat(L, format);
-}
-
-static int
-lformat_string(lua_State *L) {
-	const char *format = lua_tostring(L, lua_upvalueindex(3));
-	return lformat(L, format);
+	struct format_desc *desc = (struct format_desc *)lua_touserdata(L, lua_upvalueindex(5));
+	if (strcmp(format, desc->source) != 0) {
+		// compile into a copy, desc is the cache key and must stay intact when format is invalid
+		struct format_desc tmp;
+		tmp.from = desc->from;
+		format_compile(L, &tmp, format);
+		*desc = tmp;
+	}
+	return lformat(L, format_check(L));
 }
 
 // upvalue1: userdata mathstack
 // cfunction original function
-// cfunction function return (void *)format
+// cfunction function return (void *)format , or format string
 // integer from
+// userdata format_desc
 static int
 lbind_format(lua_State *L) {
 	if (!lua_iscfunction(L, 1))
@@ -341,21 +429,122 @@ lbind_format(lua_State *L) {
 	}
 	if (lua_getupvalue(L, 2, 1) != NULL)
 		luaL_error(L, "Only support light cfunction");
-	luaL_checkinteger(L, 3);
+	int from = luaL_checkinteger(L, 3);
 
 	lua_pushvalue(L, lua_upvalueindex(1));
 	lua_pushvalue(L, 1);
 	lua_pushvalue(L, 2);
 	lua_pushvalue(L, 3);
 
+	struct format_desc *desc = lua_newuserdatauv(L, sizeof(struct format_desc), 0);
+	desc->from = from;
+	desc->n = 0;
+	desc->source[0] = 0;
+
 	if (string_version) {
-		lua_pushcclosure(L, lformat_string, 4);
+		format_compile(L, desc, lua_tostring(L, 2));
+		lua_CFunction f;
+		switch (desc->n) {
+		case 1:
+			f = lformat_1;
+			break;
+		case 2:
+			f = lformat_2;
+			break;
+		case 3:
+			f = lformat_3;
+			break;
+		default:
+			f = lformat_string;
+			break;
+		}
+		lua_pushcclosure(L, f, 5);
 	} else {
-		lua_pushcclosure(L, lformat_function, 4);
+		lua_pushcclosure(L, lformat_function, 5);
 	}
 	return 1;
 }
 
+// upvalue1 : userdata mathstack
+// upvalue2 : cfunction
+// upvalue3 : integer type
+// upvalue4 : userdata scratch buffer
+// upvalue5 : integer from
+// The table at from is gathered into the scratch buffer and passed as (pointer, n),
+// a math3d array or a (lightuserdata, n) pair is passed through without copy.
+// The scratch buffer is reused, the cfunction should not keep the pointer.
+static int
+larray(lua_State *L) {
+	const int from = lua_tointeger(L, lua_upvalueindex(5));
+	if (lua_type(L, from) == LUA_TLIGHTUSERDATA) {
+		luaL_checkinteger(L, from+1);
+		lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
+		return f(L);
+	}
+	struct lastack *LS = GETLS(L);
+	const int type = lua_tointeger(L, lua_upvalueindex(3));
+	const int stride = lastack_typesize(type);
+	if (lua_type(L, from) == LUA_TUSERDATA) {
+		// math3d array, pass through its buffer
+		if (lua_getfield(L, from, "pointer") != LUA_TFUNCTION)
+			return luaL_error(L, "Need a math3d array");
+		lua_pushvalue(L, from);
+		lua_call(L, 1, 3);
+		if (lua_tointeger(L, -1) != stride * sizeof(float))
+			return luaL_error(L, "Invalid math3d array type");
+		lua_Integer n = lua_tointeger(L, -2);
+		lua_pop(L, 2);
+		lua_replace(L, from);
+		lua_pushinteger(L, n);
+		lua_insert(L, from+1);
+		lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
+		return f(L);
+	}
+	luaL_checktype(L, from, LUA_TTABLE);
+	const int n = (int)lua_rawlen(L, from);
+	size_t sz = (size_t)n * stride * sizeof(float) + 15;
+	void *buffer = lua_touserdata(L, lua_upvalueindex(4));
+	if (lua_rawlen(L, lua_upvalueindex(4)) < sz) {
+		buffer = lua_newuserdatauv(L, sz, 0);
+		lua_replace(L, lua_upvalueindex(4));
+	}
+	float *v = (float *)(((uintptr_t)buffer + 15) & ~(uintptr_t)15);
+	int i;
+	for (i=0;i<n;i++) {
+		lua_geti(L, from, i+1);
+		memcpy(v + i * stride, get_pointer(L, LS, -1, type), stride * sizeof(float));
+		lua_pop(L, 1);
+	}
+	lua_pushlightuserdata(L, v);
+	lua_replace(L, from);
+	lua_pushinteger(L, n);
+	lua_insert(L, from+1);
+	lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
+	return f(L);
+}
+
+// cfunction original function, called with (..., pointer, n, ...)
+// integer from
+// string type : "m" matrix, "v" vector (default), "q" quat
+static int
+lbind_array(lua_State *L) {
+	static const char * const types[] = { "m", "v", "q", NULL };
+	if (!lua_iscfunction(L, 1))
+		return luaL_error(L, "need a c function");
+	if (lua_getupvalue(L, 1, 1) != NULL)
+		luaL_error(L, "Only support light cfunction");
+	int from = luaL_checkinteger(L, 2);
+	int type = luaL_checkoption(L, 3, "v", types);
+
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_pushvalue(L, 1);
+	lua_pushinteger(L, type);	// LINEAR_TYPE_MAT/VEC4/QUAT
+	lua_newuserdatauv(L, 0, 0);
+	lua_pushinteger(L, from);
+	lua_pushcclosure(L, larray, 5);
+	return 1;
+}
+
 struct stack_buf {
 	float mat[16];
 	struct stack_buf *prev;
@@ -364,7 +553,7 @@ struct stack_buf {
 static int
 get_n(lua_State *L, int n, struct stack_buf *prev) {
 	if (n == 0) {
-		struct lastack *LS = lua_touserdata(L, lua_upvalueindex(1));
+		struct lastack *LS = GETLS(L);
 		lua_CFunction f = lua_tocfunction(L, lua_upvalueindex(2));
 		size_t sz = 0;
 		const char *format = lua_tolstring(L, lua_upvalueindex(3), &sz);
@@ -448,7 +637,7 @@ loutput_object(lua_State *L, int ltype) {
 	}
 	from = top - retn + from;
 	int i;
-	struct lastack *LS = (struct lastack *)lua_touserdata(L, lua_upvalueindex(1));
+	struct lastack *LS = GETLS(L);
 
 	for (i=from;i<=top;i++) {
 		if (lua_type(L, i) != LUA_TLIGHTUSERDATA) {
@@ -516,6 +705,7 @@ luaopen_math3d_adapter(lua_State *L) {
 		{ "vector", lbind_vector},
 		{ "variant", lbind_variant },
 		{ "format", lbind_format },
+		{ "array", lbind_array },
 		{ "getter", lbind_getter },
 		{ "output_matrix", lbind_output_matrix },
 		{ "output_vector", lbind_output_vector },
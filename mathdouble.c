@@ -0,0 +1,305 @@
+#define LUA_LIB
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "linalg.h"
+#include "math3d.h"
+#include "math3dfunc.h"
+
+// math3d.double : double precision vectors and matrices for large world coordinates.
+// The values are userdata outside of the math stack. tofloat(v, origin) converts them into
+// camera relative (origin rebased) math3d values for rendering.
+// Arguments can be double values, math3d values, or tables of numbers for vectors (read in double).
+
+struct dvalue {
+	int type;	// LINEAR_TYPE_MAT or LINEAR_TYPE_VEC4
+	double v[16];	// 4 for vector
+};
+
+static inline struct lastack *
+GETLS(lua_State *L) {
+	struct lastack *LS = (struct lastack *)lua_touserdata(L, lua_upvalueindex(1));
+	math3d_setcaller(L, LS);
+	return LS;
+}
+
+static inline size_t
+dvalue_size(int type) {
+	return offsetof(struct dvalue, v) + lastack_typesize(type) * sizeof(double);
+}
+
+// upvalue 2 : dvalue metatable
+static struct dvalue *
+to_dvalue(lua_State *L, int index) {
+	if (lua_type(L, index) != LUA_TUSERDATA || !lua_getmetatable(L, index))
+		return NULL;
+	int eq = lua_rawequal(L, -1, lua_upvalueindex(2));
+	lua_pop(L, 1);
+	return eq ? (struct dvalue *)lua_touserdata(L, index) : NULL;
+}
+
+static int
+value_type(lua_State *L, struct lastack *LS, int index) {
+	struct dvalue *D = to_dvalue(L, index);
+	if (D)
+		return D->type;
+	if (lua_type(L, index) == LUA_TTABLE)
+		return lua_rawlen(L, index) >= 3 && lua_rawlen(L, index) <= 4 ? LINEAR_TYPE_VEC4 : LINEAR_TYPE_MAT;
+	int type;
+	if (math3d_from_lua_id(L, LS, index, &type) == NULL)
+		luaL_argerror(L, index, "Need a double or math3d value");
+	return type;
+}
+
+static const double *
+get_vector(lua_State *L, struct lastack *LS, int index, double tmp[4]) {
+	struct dvalue *D = to_dvalue(L, index);
+	if (D) {
+		if (D->type != LINEAR_TYPE_VEC4)
+			luaL_argerror(L, index, "Need a double vector");
+		return D->v;
+	}
+	int i;
+	if (lua_type(L, index) == LUA_TTABLE && lua_rawlen(L, index) > 0) {
+		for (i=0;i<4;i++) {
+			if (lua_geti(L, index, i+1) == LUA_TNUMBER) {
+				tmp[i] = lua_tonumber(L, -1);
+			} else if (i == 3) {
+				tmp[i] = 0;
+			} else {
+				luaL_error(L, "Need number for vector[%d]", i+1);
+			}
+			lua_pop(L, 1);
+		}
+		return tmp;
+	}
+	const float *v = math3d_from_lua(L, LS, index, LINEAR_TYPE_VEC4);
+	for (i=0;i<4;i++)
+		tmp[i] = v[i];
+	return tmp;
+}
+
+static const double *
+get_matrix(lua_State *L, struct lastack *LS, int index, double tmp[16]) {
+	struct dvalue *D = to_dvalue(L, index);
+	if (D) {
+		if (D->type != LINEAR_TYPE_MAT)
+			luaL_argerror(L, index, "Need a double matrix");
+		return D->v;
+	}
+	const float *m = math3d_from_lua(L, LS, index, LINEAR_TYPE_MAT);
+	int i;
+	for (i=0;i<16;i++)
+		tmp[i] = m[i];
+	return tmp;
+}
+
+// push the result : the double value at index out if it's not nil, or a new one (out = 0)
+static struct dvalue *
+result_dvalue(lua_State *L, int type, int out) {
+	struct dvalue *D;
+	if (out > 0 && !lua_isnoneornil(L, out)) {
+		D = to_dvalue(L, out);
+		if (D == NULL || D->type != type)
+			luaL_error(L, "Need a double %s for output", lastack_typename(type));
+		lua_pushvalue(L, out);
+		return D;
+	}
+	D = (struct dvalue *)lua_newuserdatauv(L, dvalue_size(type), 0);
+	D->type = type;
+	lua_pushvalue(L, lua_upvalueindex(2));
+	lua_setmetatable(L, -2);
+	return D;
+}
+
+// vector(x, y, z [, w]) or vector(v) : v is a double vector, a table of numbers or a math3d vector
+static int
+lvector(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	double tmp[4];
+	const double *v;
+	if (lua_type(L, 1) == LUA_TNUMBER) {
+		tmp[0] = luaL_checknumber(L, 1);
+		tmp[1] = luaL_checknumber(L, 2);
+		tmp[2] = luaL_checknumber(L, 3);
+		tmp[3] = luaL_optnumber(L, 4, 0);
+		v = tmp;
+	} else {
+		v = get_vector(L, LS, 1, tmp);
+	}
+	struct dvalue *D = result_dvalue(L, LINEAR_TYPE_VEC4, 0);
+	memcpy(D->v, v, 4 * sizeof(double));
+	return 1;
+}
+
+// matrix(m [, t]) : m is a double matrix or a math3d matrix (or srt table), t replaces the translation in double
+static int
+lmatrix(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	double tmp[16], ttmp[4];
+	const double *m = get_matrix(L, LS, 1, tmp);
+	const double *t = lua_isnoneornil(L, 2) ? NULL : get_vector(L, LS, 2, ttmp);
+	struct dvalue *D = result_dvalue(L, LINEAR_TYPE_MAT, 0);
+	memcpy(D->v, m, 16 * sizeof(double));
+	if (t) {
+		D->v[12] = t[0];
+		D->v[13] = t[1];
+		D->v[14] = t[2];
+	}
+	return 1;
+}
+
+// mul(mat, mat [, out]) or mul(mat, vec [, out])
+static int
+lmul(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	double ltmp[16], rtmp[16];
+	const double *m = get_matrix(L, LS, 1, ltmp);
+	if (value_type(L, LS, 2) == LINEAR_TYPE_VEC4) {
+		const double *v = get_vector(L, LS, 2, rtmp);
+		struct dvalue *D = result_dvalue(L, LINEAR_TYPE_VEC4, 3);
+		math3d_transform_dvec(m, v, D->v);
+	} else {
+		const double *r = get_matrix(L, LS, 2, rtmp);
+		struct dvalue *D = result_dvalue(L, LINEAR_TYPE_MAT, 3);
+		math3d_mul_dmat(m, r, D->v);
+	}
+	return 1;
+}
+
+static int
+add_sub(lua_State *L, double sign) {
+	struct lastack *LS = GETLS(L);
+	double ltmp[4], rtmp[4];
+	const double *a = get_vector(L, LS, 1, ltmp);
+	const double *b = get_vector(L, LS, 2, rtmp);
+	struct dvalue *D = result_dvalue(L, LINEAR_TYPE_VEC4, 3);
+	int i;
+	for (i=0;i<4;i++)
+		D->v[i] = a[i] + sign * b[i];
+	return 1;
+}
+
+// add(a, b [, out])
+static int
+ladd(lua_State *L) {
+	return add_sub(L, 1);
+}
+
+// sub(a, b [, out])
+static int
+lsub(lua_State *L) {
+	return add_sub(L, -1);
+}
+
+// inverse(mat [, out])
+static int
+linverse(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	double tmp[16];
+	const double *m = get_matrix(L, LS, 1, tmp);
+	struct dvalue *D = result_dvalue(L, LINEAR_TYPE_MAT, 2);
+	math3d_inverse_dmat(m, D->v);
+	return 1;
+}
+
+// tofloat(v [, origin]) returns a math3d value. origin (double vector) is subtracted from
+// the position v, or from the translation of the matrix v, in double before rounding to float.
+// origin is weighted by w : positions need w = 1, directions (w = 0) are not moved.
+static int
+ltofloat(lua_State *L) {
+	struct lastack *LS = GETLS(L);
+	struct dvalue *D = to_dvalue(L, 1);
+	if (D == NULL)
+		return luaL_argerror(L, 1, "Need a double value");
+	double otmp[4];
+	const double *origin = lua_isnoneornil(L, 2) ? NULL : get_vector(L, LS, 2, otmp);
+	if (D->type == LINEAR_TYPE_MAT) {
+		float m[16];
+		math3d_rebase_dmat(D->v, origin, m);
+		lastack_pushmatrix(LS, m);
+	} else {
+		float v[4];
+		int i;
+		for (i=0;i<3;i++)
+			v[i] = (float)(origin ? D->v[i] - origin[i] * D->v[3] : D->v[i]);
+		v[3] = (float)D->v[3];
+		lastack_pushvec4(LS, v);
+	}
+	lua_pushlightuserdata(L, (void *)lastack_pop(LS));
+	return 1;
+}
+
+// totable(v) returns the numbers of v
+static int
+ltotable(lua_State *L) {
+	struct dvalue *D = to_dvalue(L, 1);
+	if (D == NULL)
+		return luaL_argerror(L, 1, "Need a double value");
+	const int n = lastack_typesize(D->type);
+	lua_createtable(L, n, 0);
+	int i;
+	for (i=0;i<n;i++) {
+		lua_pushnumber(L, D->v[i]);
+		lua_rawseti(L, -2, i+1);
+	}
+	return 1;
+}
+
+static int
+ltostring(lua_State *L) {
+	struct dvalue *D = (struct dvalue *)lua_touserdata(L, 1);
+	const int n = lastack_typesize(D->type);
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	luaL_addstring(&b, D->type == LINEAR_TYPE_MAT ? "DMAT(" : "DVEC(");
+	int i;
+	for (i=0;i<n;i++) {
+		lua_pushfstring(L, i == 0 ? "%f" : ",%f", (lua_Number)D->v[i]);
+		luaL_addvalue(&b);
+	}
+	luaL_addchar(&b, ')');
+	luaL_pushresult(&b);
+	return 1;
+}
+
+LUAMOD_API int
+luaopen_math3d_double(lua_State *L) {
+	luaL_checkversion(L);
+
+	luaL_Reg l[] = {
+		{ "vector", lvector },
+		{ "matrix", lmatrix },
+		{ "mul", lmul },
+		{ "add", ladd },
+		{ "sub", lsub },
+		{ "inverse", linverse },
+		{ "tofloat", ltofloat },
+		{ "totable", ltotable },
+		{ NULL, NULL },
+	};
+
+	luaL_newlibtable(L, l);
+
+	if (lua_getfield(L, LUA_REGISTRYINDEX, MATH3D_STACK) != LUA_TUSERDATA) {
+		return luaL_error(L, "request 'math3d' first");
+	}
+	struct boxstack * bs = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	lua_pushlightuserdata(L, bs->LS);
+
+	luaL_Reg dvalue_mt[] = {
+		{ "__tostring", ltostring },
+		{ NULL, NULL },
+	};
+	luaL_newlib(L, dvalue_mt);
+	lua_pushstring(L, "math3d.double");
+	lua_setfield(L, -2, "__name");
+
+	luaL_setfuncs(L,l,2);
+
+	return 1;
+}
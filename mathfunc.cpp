@@ -2,6 +2,8 @@
 #define GLM_ENABLE_EXPERIMENTAL
 
 #include <cmath>
+#include <cfloat>
+#include <cstring>
 
 extern "C" {
 	#include "linalg.h"
@@ -19,6 +21,11 @@ extern "C" {
 #include <glm/gtx/euler_angles.hpp>
 #include <glm/ext/vector_common.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MATH3D_SSE
+#include <emmintrin.h>
+#endif
+
 static const glm::vec4 XAXIS(1, 0, 0, 0);
 static const glm::vec4 YAXIS(0, 1, 0, 0);
 static const glm::vec4 ZAXIS(0, 0, 1, 0);
@@ -28,9 +35,8 @@ static const glm::vec4 NXAXIS = -XAXIS;
 static const glm::vec4 NYAXIS = -YAXIS;
 static const glm::vec4 NZAXIS = -ZAXIS;
 
-void
-math3d_make_srt(struct lastack *LS, const float *scale, const float *rot, const float *translate) {
-	glm::mat4x4 srt;
+static inline void
+make_srt(glm::mat4x4 &srt, const float *scale, const float *rot, const float *translate) {
 	if (scale) {
 		srt = glm::mat4x4(1);
 		srt[0][0] = scale[0];
@@ -53,6 +59,12 @@ math3d_make_srt(struct lastack *LS, const float *scale, const float *rot, const
 		srt[3][2] = translate[2];
 		srt[3][3] = 1;
 	}
+}
+
+void
+math3d_make_srt(struct lastack *LS, const float *scale, const float *rot, const float *translate) {
+	glm::mat4x4 srt;
+	make_srt(srt, scale, rot, translate);
 	lastack_pushmatrix(LS, &srt[0][0]);
 }
 
@@ -76,6 +88,37 @@ math3d_make_quat_from_axis(struct lastack *LS, const float *axis, float radian)
 #define VEC(v) (*(const glm::vec4 *)(v))
 #define VEC3(v) (*(const glm::vec3 *)(v))
 #define QUAT(v) (*(const glm::quat *)(v))
+#define AFF(v) (*(const glm::mat4x3 *)(v))
+
+// affine (3x4) : the rotation/scale part is a mat3, column 3 is the translation
+
+// dual quaternion : real (rotation) and dual (0.5 * t * real) parts, 8 floats
+
+static inline void
+make_dualquat(const glm::quat &r, const float t[3], float dq[8]) {
+	const float tq[4] = { t[0], t[1], t[2], 0 };
+	*(glm::quat *)dq = r;
+	*(glm::quat *)(dq + 4) = (QUAT(tq) * r) * 0.5f;
+}
+
+static inline glm::vec3
+dualquat_translation(const float dq[8]) {
+	const glm::quat t = (QUAT(dq + 4) * glm::conjugate(QUAT(dq))) * 2.0f;
+	return glm::vec3(t.x, t.y, t.z);
+}
+
+static inline glm::mat4x4
+dualquat_matrix(const float dq[8]) {
+	glm::mat4x4 m = glm::mat4x4(QUAT(dq));
+	m[3] = glm::vec4(dualquat_translation(dq), 1);
+	return m;
+}
+
+static inline glm::mat4x3
+mul_affine(const glm::mat4x3 &a, const glm::mat4x3 &b) {
+	const glm::mat3 r(a[0], a[1], a[2]);
+	return glm::mat4x3(r * b[0], r * b[1], r * b[2], r * b[3] + a[3]);
+}
 
 int
 math3d_mul_object(struct lastack *LS, const float *val0, const float *val1, int ltype, int rtype, float tmp[16]) {
@@ -88,6 +131,28 @@ math3d_mul_object(struct lastack *LS, const float *val0, const float *val1, int
 	case BINTYPE(LINEAR_TYPE_MAT,LINEAR_TYPE_MAT):
 		mat = MAT(val0) * MAT(val1);
 		return LINEAR_TYPE_MAT;
+	case BINTYPE(LINEAR_TYPE_AFFINE, LINEAR_TYPE_AFFINE):
+		*(glm::mat4x3 *)tmp = mul_affine(AFF(val0), AFF(val1));
+		return LINEAR_TYPE_AFFINE;
+	case BINTYPE(LINEAR_TYPE_AFFINE, LINEAR_TYPE_MAT):
+		mat = glm::mat4x4(AFF(val0)) * MAT(val1);
+		return LINEAR_TYPE_MAT;
+	case BINTYPE(LINEAR_TYPE_MAT, LINEAR_TYPE_AFFINE):
+		mat = MAT(val0) * glm::mat4x4(AFF(val1));
+		return LINEAR_TYPE_MAT;
+	case BINTYPE(LINEAR_TYPE_DUALQUAT, LINEAR_TYPE_DUALQUAT): {
+		const glm::quat r = QUAT(val0) * QUAT(val1);
+		const glm::quat d = QUAT(val0) * QUAT(val1 + 4) + QUAT(val0 + 4) * QUAT(val1);
+		*(glm::quat *)tmp = r;
+		*(glm::quat *)(tmp + 4) = d;
+		return LINEAR_TYPE_DUALQUAT;
+	}
+	case BINTYPE(LINEAR_TYPE_DUALQUAT, LINEAR_TYPE_MAT):
+		mat = dualquat_matrix(val0) * MAT(val1);
+		return LINEAR_TYPE_MAT;
+	case BINTYPE(LINEAR_TYPE_MAT, LINEAR_TYPE_DUALQUAT):
+		mat = MAT(val0) * dualquat_matrix(val1);
+		return LINEAR_TYPE_MAT;
 	case BINTYPE(LINEAR_TYPE_VEC4, LINEAR_TYPE_NUM):
 		vec = VEC(val0) * val1[0];
 		return LINEAR_TYPE_VEC4;
@@ -169,29 +234,149 @@ math3d_decompose_rot(const float mat[16], float quat[4]) {
 	q = glm::quat_cast(rotMat);
 }
 
-void
-math3d_decompose_matrix(struct lastack *LS, const float *mat) {
-	const glm::mat4x4 &m = *(const glm::mat4x4 *)mat;
-	float trans[4] = { m[3][0] , m[3][1], m[3][2], 1 };
-	float scale[4];
-	glm::mat3x3 rotMat(m);
-	if (!math3d_decompose_scale(mat, scale)) {
-		int ii;
-		for (ii = 0; ii < 3; ++ii) {
-			rotMat[ii] /= scale[ii];
+// Branchless glm::quat_cast : pick the biggest of 4w^2-1, 4x^2-1, 4y^2-1, 4z^2-1 and
+// gather the result from a candidate table instead of switching on the biggest index.
+static inline void
+rotation_to_quat(const float m[3][4], float q[4]) {
+	static const uint8_t gather[4][4] = {
+		{ 1, 2, 3, 0 },	// w is biggest
+		{ 0, 4, 5, 1 },	// x
+		{ 4, 0, 6, 2 },	// y
+		{ 5, 6, 0, 3 },	// z
+	};
+	const float fw = m[0][0] + m[1][1] + m[2][2];
+	const float fx = m[0][0] - m[1][1] - m[2][2];
+	const float fy = m[1][1] - m[0][0] - m[2][2];
+	const float fz = m[2][2] - m[0][0] - m[1][1];
+	int biggest = 0;
+	float v = fw;
+	biggest = fx > v ? 1 : biggest; v = fx > v ? fx : v;
+	biggest = fy > v ? 2 : biggest; v = fy > v ? fy : v;
+	biggest = fz > v ? 3 : biggest; v = fz > v ? fz : v;
+	const float root = sqrtf(v + 1) * 0.5f;
+	const float mult = 0.25f / root;
+	const float c[7] = {
+		root,
+		(m[1][2] - m[2][1]) * mult,
+		(m[2][0] - m[0][2]) * mult,
+		(m[0][1] - m[1][0]) * mult,
+		(m[0][1] + m[1][0]) * mult,
+		(m[2][0] + m[0][2]) * mult,
+		(m[1][2] + m[2][1]) * mult,
+	};
+	const uint8_t *g = gather[biggest];
+	q[0] = c[g[0]];
+	q[1] = c[g[1]];
+	q[2] = c[g[2]];
+	q[3] = c[g[3]];
+}
+
+#ifdef MATH3D_SSE
+
+static inline void
+decompose_srt(const float mat[16], float scale[4], float quat[4], float trans[4]) {
+	__m128 c0 = _mm_loadu_ps(mat);
+	__m128 c1 = _mm_loadu_ps(mat + 4);
+	__m128 c2 = _mm_loadu_ps(mat + 8);
+	__m128 c3 = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	// c0/c1/c2 are the x/y/z rows now, lane i is column i
+	__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, c0), _mm_mul_ps(c1, c1)), _mm_mul_ps(c2, c2));
+	__m128 one = _mm_set1_ps(1.0f);
+	// see equal_one()
+	__m128i bits = _mm_and_si128(_mm_add_epi32(_mm_castps_si128(dot), _mm_set1_epi32(0x1f)), _mm_set1_epi32(~0x3f));
+	__m128 isone = _mm_castsi128_ps(_mm_cmpeq_epi32(bits, _mm_set1_epi32(0x3f800000)));
+	__m128 s = _mm_or_ps(_mm_and_ps(isone, one), _mm_andnot_ps(isone, _mm_sqrt_ps(dot)));
+	// lane 3 is always zero, so check the xyz lanes only
+	const int zero = _mm_movemask_ps(_mm_cmpeq_ps(s, _mm_setzero_ps())) & 7;
+	s = zero ? one : s;
+	_mm_storeu_ps(scale, s);
+	scale[3] = 0;
+	__m128 r[3] = { _mm_div_ps(c0, s), _mm_div_ps(c1, s), _mm_div_ps(c2, s) };
+	float m[3][4];
+	_MM_TRANSPOSE4_PS(r[0], r[1], r[2], c3);
+	_mm_storeu_ps(m[0], r[0]);
+	_mm_storeu_ps(m[1], r[1]);
+	_mm_storeu_ps(m[2], r[2]);
+	rotation_to_quat(m, quat);
+	trans[0] = mat[3*4+0];
+	trans[1] = mat[3*4+1];
+	trans[2] = mat[3*4+2];
+	trans[3] = 1;
+}
+
+#else
+
+static inline void
+decompose_srt(const float mat[16], float scale[4], float quat[4], float trans[4]) {
+	float m[3][4];
+	int uniform = math3d_decompose_scale(mat, scale);
+	int ii, jj;
+	for (ii = 0; ii < 3; ++ii) {
+		const float s = uniform ? 1.0f : scale[ii];
+		for (jj = 0; jj < 3; ++jj) {
+			m[ii][jj] = mat[ii*4+jj] / s;
 		}
 	}
-	glm::quat q = glm::quat_cast(rotMat);
+	rotation_to_quat(m, quat);
+	trans[0] = mat[3*4+0];
+	trans[1] = mat[3*4+1];
+	trans[2] = mat[3*4+2];
+	trans[3] = 1;
+}
+
+#endif
+
+void
+math3d_decompose_matrix(struct lastack *LS, const float *mat) {
+	float scale[4], quat[4], trans[4];
+	decompose_srt(mat, scale, quat, trans);
 	lastack_pushvec4(LS, trans);
-	lastack_pushquat(LS, &q.x);
+	lastack_pushquat(LS, quat);
 	lastack_pushvec4(LS, scale);
 }
 
+void
+math3d_decompose_matrix_array(const float *mat, int n, float *scale, float *rot, float *trans) {
+	float tmp[4];
+	int i;
+	for (i = 0; i < n; i++) {
+		decompose_srt(mat + i * 16,
+			scale ? scale + i * 4 : tmp,
+			rot ? rot + i * 4 : tmp,
+			trans ? trans + i * 4 : tmp);
+	}
+}
+
 float
 math3d_length(const float *v) {
 	return glm::length(VEC3(v));
 }
 
+// Approximate rsqrt/rcp : the hardware estimate (relative error <= 1.5*2^-12)
+// refined by one Newton-Raphson step. The relative error of the result is
+// below 2^-21 (about 4.8e-7, a few ulps), and math3d_*_fast inherit this bound.
+// Without SSE they fall back to the exact operations.
+// The estimate is inf for denormals (and 0), the exact operations are used below FLT_MIN.
+
+static inline float
+rsqrt_fast(float x) {
+#ifdef MATH3D_SSE
+	if (x < FLT_MIN)
+		return 1.0f / sqrtf(x);
+	const float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+	return y * (1.5f - 0.5f * x * y * y);
+#else
+	return 1.0f / sqrtf(x);
+#endif
+}
+
+float
+math3d_length_fast(const float *v) {
+	const float dot = glm::dot(VEC3(v), VEC3(v));
+	return dot > 0 ? dot * rsqrt_fast(dot) : 0;
+}
+
 void
 math3d_floor(struct lastack *LS, const float v[4]) {
 	glm::vec4 vv(glm::floor(VEC3(v)), 0.f);
@@ -215,8 +400,8 @@ math3d_cross(struct lastack *LS, const float v1[4], const float v2[4]) {
 	lastack_pushvec4(LS, &r.x);
 }
 
-void
-math3d_mulH(struct lastack *LS, const float mat[16], const float vec[4]) {
+static inline glm::vec4
+mulH(const float mat[16], const float vec[4]) {
 	glm::vec4 r;
 
 	if (vec[3] != 1.f){
@@ -231,6 +416,12 @@ math3d_mulH(struct lastack *LS, const float mat[16], const float vec[4]) {
 		r.w = 1.f;
 	}
 
+	return r;
+}
+
+void
+math3d_mulH(struct lastack *LS, const float mat[16], const float vec[4]) {
+	glm::vec4 r = mulH(mat, vec);
 	lastack_pushvec4(LS, &r.x);
 }
 
@@ -246,6 +437,26 @@ math3d_normalize_quat(struct lastack *LS, const float v[4]) {
 	lastack_pushquat(LS, &q.x);
 }
 
+void
+math3d_normalize_vector_fast(struct lastack *LS, const float v[4]) {
+	const float inv = rsqrt_fast(glm::dot(VEC3(v), VEC3(v)));
+	glm::vec4 r(VEC3(v) * inv, v[3]);
+	lastack_pushvec4(LS, &r.x);
+}
+
+void
+math3d_normalize_quat_fast(struct lastack *LS, const float v[4]) {
+	const float dot = glm::dot(VEC(v), VEC(v));
+	if (dot <= 0) {
+		// the same as glm::normalize
+		static const float identity[4] = { 0, 0, 0, 1 };
+		lastack_pushquat(LS, identity);
+		return;
+	}
+	glm::vec4 q = VEC(v) * rsqrt_fast(dot);
+	lastack_pushquat(LS, &q.x);
+}
+
 void
 math3d_transpose_matrix(struct lastack *LS, const float mat[16]) {
 	glm::mat4x4 r = glm::transpose(MAT(mat));
@@ -258,25 +469,113 @@ math3d_inverse_matrix(struct lastack *LS, const float mat[16]) {
 	lastack_pushmatrix(LS, &r[0][0]);
 }
 
+void
+math3d_inverse_affine(struct lastack *LS, const float m[12]) {
+	const glm::mat3 r = glm::inverse(glm::mat3(AFF(m)));
+	const glm::mat4x3 a(r[0], r[1], r[2], -(r * AFF(m)[3]));
+	lastack_pushaffine(LS, &a[0][0]);
+}
+
+void
+math3d_affine_transform(struct lastack *LS, const float m[12], const float v[4]) {
+	const glm::mat4x3 &a = AFF(m);
+	const glm::vec4 r(glm::mat3(a) * VEC3(v) + a[3] * v[3], v[3]);
+	lastack_pushvec4(LS, &r.x);
+}
+
+void
+math3d_affine_to_matrix(const float m[12], float r[16]) {
+	*(glm::mat4x4 *)r = glm::mat4x4(AFF(m));
+}
+
+void
+math3d_matrix_to_affine(const float m[16], float r[12]) {
+	*(glm::mat4x3 *)r = glm::mat4x3(MAT(m));
+}
+
+// relative tolerance to treat a matrix as rigid or uniform scaled
+#define NORMAL_MATRIX_EPSILON 1e-5f
+
+static inline void
+normal_matrix(const float mat[16], float *out, int stride) {
+	const glm::vec3 &c0 = VEC3(mat);
+	const glm::vec3 &c1 = VEC3(mat+4);
+	const glm::vec3 &c2 = VEC3(mat+8);
+	glm::vec3 r[3];
+	const float d00 = glm::dot(c0, c0);
+	const float e = d00 * NORMAL_MATRIX_EPSILON;
+	if (d00 > 0
+		&& fabsf(glm::dot(c1, c1) - d00) <= e
+		&& fabsf(glm::dot(c2, c2) - d00) <= e
+		&& fabsf(glm::dot(c0, c1)) <= e
+		&& fabsf(glm::dot(c0, c2)) <= e
+		&& fabsf(glm::dot(c1, c2)) <= e) {
+		// inverse-transpose of s*R is R/s
+		const float inv = equal_one(d00) ? 1.0f : 1.0f / d00;
+		r[0] = c0 * inv;
+		r[1] = c1 * inv;
+		r[2] = c2 * inv;
+	} else {
+		// cofactor matrix / determinant
+		r[0] = glm::cross(c1, c2);
+		r[1] = glm::cross(c2, c0);
+		r[2] = glm::cross(c0, c1);
+		const float det = glm::dot(c0, r[0]);
+		if (det != 0) {
+			const float inv = 1.0f / det;
+			r[0] *= inv;
+			r[1] *= inv;
+			r[2] *= inv;
+		} else {
+			// singular, keep it as is
+			r[0] = c0;
+			r[1] = c1;
+			r[2] = c2;
+		}
+	}
+	const int column = stride / 3;
+	int ii;
+	for (ii = 0; ii < 3; ++ii) {
+		float *c = out + ii * column;
+		c[0] = r[ii].x;
+		c[1] = r[ii].y;
+		c[2] = r[ii].z;
+		if (column == 4)
+			c[3] = 0;
+	}
+}
+
+void
+math3d_normal_matrix_array(const float *mat, int n, float *out, int stride) {
+	int i;
+	for (i = 0; i < n; i++) {
+		normal_matrix(mat + i * 16, out + i * stride, stride);
+	}
+}
+
 void
 math3d_inverse_quat(struct lastack *LS, const float quat[4]) {
 	glm::quat q = glm::inverse(QUAT(quat));
 	lastack_pushquat(LS, &q.x);
 }
 
-void
-math3d_lookat_matrix(struct lastack *LS, int direction, const float eye[3], const float at[3], const float *up) {
-	glm::mat4x4 m;
+static inline glm::mat4x4
+lookat_matrix(int direction, const float eye[3], const float at[3], const float *up) {
 	if (up == NULL) {
 		static const float default_up[3] = {0,1,0};
 		up = default_up;
 	}
 	if (direction) {
 		const glm::vec3 vat = VEC3(eye) + VEC3(at);
-		m = glm::lookAtLH(VEC3(eye), vat, VEC3(up));
+		return glm::lookAtLH(VEC3(eye), vat, VEC3(up));
 	} else {
-		m = glm::lookAtLH(VEC3(eye), VEC3(at), VEC3(up));
+		return glm::lookAtLH(VEC3(eye), VEC3(at), VEC3(up));
 	}
+}
+
+void
+math3d_lookat_matrix(struct lastack *LS, int direction, const float eye[3], const float at[3], const float *up) {
+	glm::mat4x4 m = lookat_matrix(direction, eye, at, up);
 	lastack_pushmatrix(LS, &m[0][0]);
 }
 
@@ -300,6 +599,25 @@ math3d_reciprocal(struct lastack *LS, const float v[4]) {
 	lastack_pushvec4(LS, &vv.x);
 }
 
+void
+math3d_reciprocal_fast(struct lastack *LS, const float v[4]) {
+#ifdef MATH3D_SSE
+	const __m128 x = _mm_loadu_ps(v);
+	const __m128 y = _mm_rcp_ps(x);
+	__m128 r = _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(2.0f), _mm_mul_ps(x, y)));
+	// the newton step turns the estimate of 0 and denormals (inf) into nan or -inf, divide them exactly
+	const __m128 tiny = _mm_cmplt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), x), _mm_set1_ps(FLT_MIN));
+	if (_mm_movemask_ps(tiny))
+		r = _mm_or_ps(_mm_and_ps(tiny, _mm_div_ps(_mm_set1_ps(1.0f), x)), _mm_andnot_ps(tiny, r));
+	float vv[4];
+	_mm_storeu_ps(vv, r);
+	vv[3] = v[3];
+	lastack_pushvec4(LS, vv);
+#else
+	math3d_reciprocal(LS, v);
+#endif
+}
+
 void
 math3d_quat_to_viewdir(struct lastack *LS, const float q[4]) {
 	glm::vec4 d = glm::rotate(QUAT(q), glm::vec4(0, 0, 1, 0));
@@ -335,27 +653,25 @@ math3d_orthoLH(struct lastack *LS, float left, float right, float bottom, float
 }
 
 void
-math3d_base_axes(struct lastack *LS, const float forward[4]) {
-	glm::vec4 right, up;
+math3d_base_axes(const float forward[4], float right[4], float up[4]) {
+	glm::vec4 &r = *(glm::vec4 *)right;
+	glm::vec4 &u = *(glm::vec4 *)up;
 
 	if (is_equal(VEC(forward), ZAXIS)) {
-		up = YAXIS;
-		right = XAXIS;
+		u = YAXIS;
+		r = XAXIS;
 	} else {
 		if (is_equal(VEC(forward), YAXIS)) {
-			up = NZAXIS;
-			right = XAXIS;
+			u = NZAXIS;
+			r = XAXIS;
 		} else if (is_equal(VEC(forward), NYAXIS)) {
-			up = ZAXIS;
-			right = XAXIS;
+			u = ZAXIS;
+			r = XAXIS;
 		} else {
-			right = glm::vec4(glm::normalize(glm::cross(VEC3(&YAXIS.x), VEC3(forward))), 0);
-			up = glm::vec4(glm::normalize(glm::cross(VEC3(forward), VEC3(&right.x))), 0);
+			r = glm::vec4(glm::normalize(glm::cross(VEC3(&YAXIS.x), VEC3(forward))), 0);
+			u = glm::vec4(glm::normalize(glm::cross(VEC3(forward), VEC3(right))), 0);
 		}
 	}
-
-	lastack_pushvec4(LS, &up.x);
-	lastack_pushvec4(LS, &right.x);
 }
 
 void
@@ -377,6 +693,122 @@ math3d_minmax(struct lastack *LS, const float mat[16], const float v[4], float m
 	*(glm::vec4*)minv = glm::min(vv, VEC(minv));
 }
 
+void
+math3d_minmax_array(const float mat[16], const float *v, int stride, int n, float minv[4], float maxv[4]) {
+	glm::vec4 vmin = VEC(minv);
+	glm::vec4 vmax = VEC(maxv);
+	int i;
+	if (mat) {
+		const glm::mat4x4 m = MAT(mat);
+		for (i = 0; i < n; i++) {
+			const glm::vec4 vv = m * VEC(v + i * stride);
+			vmin = glm::min(vv, vmin);
+			vmax = glm::max(vv, vmax);
+		}
+	} else {
+		for (i = 0; i < n; i++) {
+			vmin = glm::min(VEC(v + i * stride), vmin);
+			vmax = glm::max(VEC(v + i * stride), vmax);
+		}
+	}
+	*(glm::vec4*)minv = vmin;
+	*(glm::vec4*)maxv = vmax;
+}
+
+void
+math3d_transform_array(const float mat[16], const float *v, int vstride, int n, const float *w, float *out, int ostride) {
+	const glm::mat4x4 m = MAT(mat);
+	int i;
+	if (w) {
+		for (i = 0; i < n; i++) {
+			*(glm::vec4*)(out + i * ostride) = m * glm::vec4(VEC3(v + i * vstride), *w);
+		}
+	} else {
+		for (i = 0; i < n; i++) {
+			*(glm::vec4*)(out + i * ostride) = m * VEC(v + i * vstride);
+		}
+	}
+}
+
+void
+math3d_make_dualquat(struct lastack *LS, const float r[4], const float t[3]) {
+	static const float ident[4] = { 0, 0, 0, 1 };
+	static const float zero[3] = { 0, 0, 0 };
+	float dq[8];
+	make_dualquat(QUAT(r ? r : ident), t ? t : zero, dq);
+	lastack_pushdualquat(LS, dq);
+}
+
+void
+math3d_matrix_to_dualquat(struct lastack *LS, const float mat[16]) {
+	float scale[4], quat[4], trans[4], dq[8];
+	decompose_srt(mat, scale, quat, trans);
+	make_dualquat(QUAT(quat), trans, dq);
+	lastack_pushdualquat(LS, dq);
+}
+
+void
+math3d_dualquat_to_matrix(struct lastack *LS, const float dq[8]) {
+	const glm::mat4x4 m = dualquat_matrix(dq);
+	lastack_pushmatrix(LS, &m[0][0]);
+}
+
+void
+math3d_decompose_dualquat(struct lastack *LS, const float dq[8]) {
+	const float scale[4] = { 1, 1, 1, 0 };
+	const glm::vec4 t(dualquat_translation(dq), 1);
+	lastack_pushvec4(LS, &t.x);
+	lastack_pushquat(LS, dq);
+	lastack_pushvec4(LS, scale);
+}
+
+void
+math3d_normalize_dualquat(struct lastack *LS, const float dq[8]) {
+	const float len = glm::length(QUAT(dq));
+	float r[8];
+	int i;
+	for (i = 0; i < 8; i++) {
+		r[i] = len > 0 ? dq[i] / len : dq[i];
+	}
+	lastack_pushdualquat(LS, r);
+}
+
+void
+math3d_inverse_dualquat(struct lastack *LS, const float dq[8]) {
+	float r[8];
+	*(glm::quat *)r = glm::conjugate(QUAT(dq));
+	*(glm::quat *)(r + 4) = glm::conjugate(QUAT(dq + 4));
+	lastack_pushdualquat(LS, r);
+}
+
+void
+math3d_dualquat_transform(struct lastack *LS, const float dq[8], const float v[4]) {
+	const glm::vec4 r(QUAT(dq) * VEC3(v) + dualquat_translation(dq) * v[3], v[3]);
+	lastack_pushvec4(LS, &r.x);
+}
+
+void
+math3d_dualquat_transform_array(const float dq[8], const float *v, int vstride, int n, const float *w, float *out, int ostride) {
+	const glm::mat3x3 r = glm::mat3x3(QUAT(dq));
+	const glm::vec3 t = dualquat_translation(dq);
+	int i;
+	for (i = 0; i < n; i++) {
+		const float *p = v + i * vstride;
+		const float pw = w ? *w : p[3];
+		*(glm::vec4*)(out + i * ostride) = glm::vec4(r * VEC3(p) + t * pw, pw);
+	}
+}
+
+void
+math3d_dualquat_array(const float *mats, int n, float *out, int stride) {
+	float scale[4], quat[4], trans[4];
+	int i;
+	for (i = 0; i < n; i++) {
+		decompose_srt(mats + i * 16, scale, quat, trans);
+		make_dualquat(QUAT(quat), trans, out + i * stride);
+	}
+}
+
 void 
 math3d_lerp(struct lastack *LS, const float v0[4], const float v1[4], float ratio, float r[4]){
 	*(glm::vec4*)r = glm::lerp(VEC(v0), VEC(v1), ratio);
@@ -410,3 +842,176 @@ math3d_dir2radian(struct lastack *LS, const float v[4], float radians[2]){
 		radians[1] = is_zero(v[0]) ? 0.f : std::atan2(v[0], v[2]);
 	}
 }
+
+// double precision, see math3d.double
+
+#define DMAT(v) (*(const glm::dmat4x4 *)(v))
+#define DVEC(v) (*(const glm::dvec4 *)(v))
+
+void
+math3d_mul_dmat(const double a[16], const double b[16], double r[16]) {
+	*(glm::dmat4x4 *)r = DMAT(a) * DMAT(b);
+}
+
+void
+math3d_transform_dvec(const double mat[16], const double v[4], double r[4]) {
+	*(glm::dvec4 *)r = DMAT(mat) * DVEC(v);
+}
+
+void
+math3d_inverse_dmat(const double mat[16], double r[16]) {
+	*(glm::dmat4x4 *)r = glm::inverse(DMAT(mat));
+}
+
+// translate by -origin (the columns with w != 0) in double, then round to float
+void
+math3d_rebase_dmat(const double mat[16], const double origin[3], float r[16]) {
+	glm::dmat4x4 m = DMAT(mat);
+	if (origin) {
+		int ii;
+		for (ii = 0; ii < 4; ++ii) {
+			m[ii].x -= origin[0] * m[ii].w;
+			m[ii].y -= origin[1] * m[ii].w;
+			m[ii].z -= origin[2] * m[ii].w;
+		}
+	}
+	*(glm::mat4x4 *)r = glm::mat4x4(m);
+}
+
+static inline void
+rebase_output(const glm::mat4x4 &rel, const float view[16], float *world, float *worldview) {
+	if (world)
+		*(glm::mat4x4 *)world = rel;
+	if (worldview)
+		*(glm::mat4x4 *)worldview = MAT(view) * rel;
+}
+
+void
+math3d_rebase_array(const float *mats, const float *low, int lstride, int n, const double origin[3], const float view[16], float *world, int wstride, float *worldview, int wvstride) {
+	int i, ii;
+	for (i = 0; i < n; i++) {
+		const float *m = mats + i * 16;
+		const float *l = low ? low + i * lstride : NULL;
+		glm::mat4x4 rel = MAT(m);
+		for (ii = 0; ii < 3; ++ii) {
+			rel[3][ii] = (float)((double)m[12+ii] - origin[ii] + (l ? l[ii] : 0));
+		}
+		rebase_output(rel, view,
+			world ? world + i * wstride : NULL,
+			worldview ? worldview + i * wvstride : NULL);
+	}
+}
+
+void
+math3d_rebase_dmat_array(const double *mats, int n, const double origin[3], const float view[16], float *world, int wstride, float *worldview, int wvstride) {
+	int i;
+	for (i = 0; i < n; i++) {
+		double m[16];
+		memcpy(m, mats + i * 16, sizeof(m));
+		glm::mat4x4 rel;
+		math3d_rebase_dmat(m, origin, &rel[0][0]);
+		rebase_output(rel, view,
+			world ? world + i * wstride : NULL,
+			worldview ? worldview + i * wvstride : NULL);
+	}
+}
+
+#define RESULT_MAT(r) (*(glm::mat4x4 *)(r))
+#define RESULT_VEC(r) (*(glm::vec4 *)(r))
+#define RESULT_QUAT(r) (*(glm::quat *)(r))
+
+void
+math3d_program_exec(const struct math3d_instruction *code, int n, const float **reg, int base, float (*result)[16]) {
+	int i;
+	for (i = 0; i < n; i++) {
+		const struct math3d_instruction *inst = &code[i];
+		const float *a = reg[inst->arg[0]];
+		const float *b = reg[inst->arg[1]];
+		const float *c = inst->arg[2] == MATH3D_NOARG ? NULL : reg[inst->arg[2]];
+		float *r = result[i];
+		reg[base + i] = r;
+		switch (inst->op) {
+		case MATH3D_OP_MUL_MAT:
+			RESULT_MAT(r) = MAT(a) * MAT(b);
+			break;
+		case MATH3D_OP_MUL_QUAT:
+			RESULT_QUAT(r) = QUAT(a) * QUAT(b);
+			break;
+		case MATH3D_OP_MUL_VEC:
+			RESULT_VEC(r) = VEC(a) * VEC(b);
+			break;
+		case MATH3D_OP_SCALE_VEC:
+			RESULT_VEC(r) = VEC(a) * b[0];
+			break;
+		case MATH3D_OP_ADD:
+			RESULT_VEC(r) = VEC(a) + VEC(b);
+			break;
+		case MATH3D_OP_SUB:
+			RESULT_VEC(r) = VEC(a) - VEC(b);
+			break;
+		case MATH3D_OP_TRANSFORM_QUAT:
+			RESULT_VEC(r) = glm::rotate(QUAT(a), VEC(b));
+			break;
+		case MATH3D_OP_TRANSFORM_MAT:
+			RESULT_VEC(r) = MAT(a) * VEC(b);
+			break;
+		case MATH3D_OP_TRANSFORMH:
+			RESULT_VEC(r) = mulH(a, b);
+			break;
+		case MATH3D_OP_INVERSE_MAT:
+			RESULT_MAT(r) = glm::inverse(MAT(a));
+			break;
+		case MATH3D_OP_INVERSE_QUAT:
+			RESULT_QUAT(r) = glm::inverse(QUAT(a));
+			break;
+		case MATH3D_OP_INVERSE_VEC:
+			RESULT_VEC(r) = glm::vec4(-VEC3(a), a[3]);
+			break;
+		case MATH3D_OP_TRANSPOSE:
+			RESULT_MAT(r) = glm::transpose(MAT(a));
+			break;
+		case MATH3D_OP_NORMALIZE_VEC:
+			RESULT_VEC(r) = glm::vec4(glm::normalize(VEC3(a)), a[3]);
+			break;
+		case MATH3D_OP_NORMALIZE_QUAT:
+			RESULT_QUAT(r) = glm::normalize(QUAT(a));
+			break;
+		case MATH3D_OP_LOOKAT:
+			RESULT_MAT(r) = lookat_matrix(0, a, b, c);
+			break;
+		case MATH3D_OP_LOOKTO:
+			RESULT_MAT(r) = lookat_matrix(1, a, b, c);
+			break;
+		case MATH3D_OP_QUAT_TO_MAT:
+			RESULT_MAT(r) = glm::mat4x4(QUAT(a));
+			break;
+		case MATH3D_OP_MAT_TO_QUAT:
+			RESULT_QUAT(r) = glm::quat_cast(MAT(a));
+			break;
+		case MATH3D_OP_SRT:
+			make_srt(RESULT_MAT(r), a, b, c);
+			break;
+		case MATH3D_OP_CROSS:
+			RESULT_VEC(r) = glm::vec4(glm::cross(VEC3(a), VEC3(b)), 0);
+			break;
+		case MATH3D_OP_DOT:
+			r[0] = glm::dot(VEC3(a), VEC3(b));
+			break;
+		case MATH3D_OP_LENGTH:
+			r[0] = glm::length(VEC3(a));
+			break;
+		case MATH3D_OP_LERP:
+			RESULT_VEC(r) = glm::lerp(VEC(a), VEC(b), c[0]);
+			break;
+		case MATH3D_OP_RECIPROCAL:
+			RESULT_VEC(r) = glm::vec4(1.f / VEC3(a), a[3]);
+			break;
+		case MATH3D_OP_TODIRECTION_QUAT:
+			RESULT_VEC(r) = glm::rotate(QUAT(a), glm::vec4(0, 0, 1, 0));
+			break;
+		case MATH3D_OP_TODIRECTION_MAT:
+			RESULT_VEC(r) = MAT(a) * glm::vec4(0, 0, 1, 0);
+			break;
+		}
+	}
+}
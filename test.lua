@@ -9,7 +9,7 @@ print("ref1", ref1)
 print("ref1 value", math3d.tostring(math3d.matrix(ref1)))
 print(ref2)
 print("ref2 value", math3d.tostring(math3d.vector(ref2)))
-ref2.v = math3d.pack("dddd", 1,2,3,4)
+ref2.v = string.pack("<i4i4i4i4", 1,2,3,4)	-- binary string
 print(ref2)
 ref2.v = math3d.vector(ref2, 1)
 print("ref2", ref2)
@@ -41,6 +41,35 @@ ref1.s = 1
 print_srt()
 ref1.s = { 3,2,1 }
 print_srt()
+ref1.r = { axis = {0,0,1}, r = math.rad(30) }
+ref1.t = { 4,5,6 }
+ref1.s = 2
+print_srt()
+print(ref1)
+
+print "===SRT ARRAY==="
+do
+	local mats = { ref1, math3d.matrix { s = { 1, 2, 3 }, r = { axis = {0,0,1}, r = math.rad(45) }, t = { 4,5,6 } } }
+	local s, r, t = math3d.srt_array(mats)
+	for i = 1, #mats do
+		local offset = (i-1) * 16 + 1
+		print("S = ", string.unpack("<ffff", s, offset))
+		print("R = ", string.unpack("<ffff", r, offset))
+		print("T = ", string.unpack("<ffff", t, offset))
+	end
+end
+
+print "===NORMAL MATRIX==="
+do
+	local mats = { ref1, math3d.matrix { s = { 1, 2, 3 }, r = { axis = {0,0,1}, r = math.rad(45) }, t = { 4,5,6 } } }
+	local n33 = math3d.normal_array(mats, "3x3")
+	local n34 = math3d.normal_array(mats, "3x4")
+	for i = 1, #mats do
+		print("3x3", string.unpack("<fffffffff", n33, (i-1) * 36 + 1))
+		print("3x4", string.unpack("<ffffffffffff", n34, (i-1) * 48 + 1))
+		print("inverse-transpose", math3d.tostring(math3d.transpose(math3d.inverse(mats[i]))))
+	end
+end
 
 print "===QUAT==="
 
@@ -71,6 +100,32 @@ print("inverse", ref2, "=", math3d.tostring(math3d.inverse(ref2)))
 print("inverse", ref3, "=", math3d.tostring(math3d.inverse(ref3)))
 print("reciprocal", ref2, "=", math3d.tostring(math3d.reciprocal(ref2)))
 
+print "===FAST MATH==="
+do
+	-- fast path relative error bound is 2^-21, plus the rounding error of the exact path
+	local bound = 2^-20
+	local function check(name, exact, fast)
+		for i = 1, 4 do
+			local e, f = math3d.index(exact, i), math3d.index(fast, i)
+			assert(math.abs(e - f) <= math.abs(e) * bound, name)
+		end
+	end
+	-- the last one has denormal components (and a denormal squared length)
+	for _, v in ipairs { {1,2,3}, {-0.001,0.5,1000}, {1e-3,1e-4,1e-5}, {123,-456,789}, {1e-20,5e-39,-1e-38} } do
+		local vec = math3d.vector(v)
+		check("normalize", math3d.normalize(vec), math3d.normalize(vec, "fast"))
+		check("reciprocal", math3d.reciprocal(vec), math3d.reciprocal(vec, "fast"))
+		local quat = math3d.quaternion { v[1], v[2], v[3], 1 }
+		check("normalize quat", math3d.normalize(quat), math3d.normalize(quat, "fast"))
+		local len = math3d.length(vec)
+		assert(math.abs(len - math3d.length(vec, "fast")) <= len * bound, "length")
+	end
+	math3d.precision "fast"
+	print("precision", math3d.precision(), math3d.tostring(math3d.normalize(ref2)))
+	math3d.precision "exact"
+	print("precision", math3d.precision(), math3d.tostring(math3d.normalize(ref2)))
+end
+
 print "===MULADD==="
 do
 	local v1, v2 = math3d.vector(1, 2, 3, 0), math3d.vector(1, 0, 0, 0)
@@ -141,6 +196,170 @@ print "===PROJ===="
 local projmat = math3d.projmat {fov=90, aspect=1, n=1, f=1000}
 print("PROJ", math3d.tostring(projmat))
 
+print "===ARRAY==="
+do
+	local arr = math3d.array("v", 3)
+	arr[1] = { 1, 2, 3 }
+	arr:fill(math3d.vector(4, 5, 6), 2)
+	arr[3] = math3d.add(arr[1], arr[2])
+	print(arr, #arr, math3d.tostring(arr[1]), math3d.tostring(arr[2]), math3d.tostring(arr[3]))
+	local mats = math3d.array("m", 2)
+	mats:copy { ref1, math3d.matrix { s = 2 } }
+	print("mul", math3d.tostring(math3d.mul(mats[1], mats[2])))
+	print("srt_array", string.unpack("<ffff", (math3d.srt_array(mats))))
+	local r = math3d.ref(arr[1])
+	arr[1] = { 0, 0, 0 }
+	print("ref copy", r, math3d.tostring(arr[1]))
+	print("pointer", mats:pointer())
+end
+
+print "===PROFILE==="
+do
+	local p = math3d.profile(true)	-- nil without MATH3D_PROFILE
+	if p then
+		math3d.mul(ref1, ref1)
+		local s = math3d.profile().mul
+		print("profile mul", s.count, s.temps)
+	end
+end
+
+print "===ALLOC REPORT==="
+do
+	math3d.alloc_report(1)
+	for _ = 1, 10 do
+		math3d.add(ref2, ref2)
+	end
+	math3d.alloc_report(0)
+	local site = math3d.alloc_report()[1]
+	print("alloc", site.source, site.line, site.count, site.bytes)
+end
+
+print "===TRACE==="
+do
+	math3d.trace(1024)
+	local points = math3d.array("v", 16)
+	math3d.transform_array(ref1, points, nil)
+	math3d.reset()
+	math3d.trace(false)
+	print("trace", math3d.trace_dump "math3d_trace.json")
+	os.remove "math3d_trace.json"
+end
+
+print "===REFARRAY==="
+do
+	local nodes = math3d.refarray(3)
+	nodes[1] = math3d.vector(1, 2, 3)
+	nodes:set(2, "m", { s = 2, t = { 1, 2, 3 } })
+	nodes:set(2, "t", { 4, 5, 6 })
+	nodes:set(3, "q", { axis = {0,1,0}, r = math.rad(90) })
+	print(nodes, #nodes, math3d.tostring(nodes[1]), math3d.tostring(nodes[2]), math3d.tostring(nodes[3]))
+	print("get", math3d.tostring(nodes:get(2, "t")), nodes:get(1, "v")[3])
+	nodes[1] = nil
+	print("clear", nodes:get(1))
+end
+
+print "===BINARY==="
+do
+	local data = string.pack("<ffff", 1, 2, 3, 4) .. string.pack("<ffff", 0, 0, 0, 1)
+	print("vector", math3d.tostring(math3d.vector(data)), math3d.tostring(math3d.vector(data, 17)))
+	print("quaternion", math3d.tostring(math3d.quaternion(data, 17)))
+	local mat = string.pack("<ffffffffffffffff", 1,0,0,0, 0,1,0,0, 0,0,1,0, 5,6,7,1)
+	print("matrix", math3d.tostring(math3d.matrix(mat)))
+	local r = math3d.ref()
+	r.m = mat
+	print("ref", r)
+	local arr = math3d.array("v", data)
+	print("array", arr, math3d.tostring(arr[1]), math3d.tostring(arr[2]))
+	arr:copy(string.pack("<ffff", 9, 9, 9, 9), 2)
+	print("copy", math3d.tostring(arr[2]))
+	print("trailing", pcall(math3d.array, "v", data .. "x"), pcall(arr.copy, arr, data .. "x"))
+end
+
+print "===VIEW==="
+do
+	local points = math3d.array("v", 4)
+	points:copy { {1,2,3,1}, {-1,0,5,1}, {4,-2,0,1}, {0,0,0,1} }
+	local ptr, n, stride = points:pointer()
+	local view = math3d.view(ptr, n, stride, "v", true)
+	print(view, math3d.tostring(view[2]))
+	local minv, maxv = math3d.minmax(view)
+	print("minmax", math3d.tostring(minv), math3d.tostring(maxv))
+	local out = math3d.array("v", 4)
+	math3d.transform_array(ref1, view, out)
+	print("transform_array", math3d.tostring(out[1]), math3d.tostring(math3d.transform(ref1, view[1], nil)))
+	math3d.transform_array(ref1, out, nil, 0)
+	print("transform_array w=0", math3d.tostring(out[1]))
+	print("readonly", pcall(view.fill, view, math3d.vector(0,0,0)))
+	local bounds = math3d.array("v", 2)
+	math3d.minmax(view, nil, bounds)
+	print("minmax array", math3d.tostring(bounds[1]), math3d.tostring(bounds[2]))
+	-- interleaved : a vec4 field after each element
+	local buffer = math3d.array("v", 10)
+	buffer:fill(math3d.vector(7,7,7,7))
+	local bptr = buffer:pointer()
+	local strided = math3d.view(bptr, 4, 32, "v")
+	strided:fill(math3d.vector(1,2,3,4))
+	strided:copy(view, 1)
+	strided[4] = math3d.vector(5,6,7,8)
+	print("strided", math3d.tostring(strided[2]), math3d.tostring(buffer[2]), math3d.tostring(buffer[8]))
+	local mats = math3d.view(bptr, 2, 80, "m")
+	mats:copy { math3d.matrix { t = {1,2,3} }, math3d.matrix { s = 2 } }
+	local _, _, t = math3d.srt_array(mats)
+	print("strided srt_array", #t, string.unpack("<fff", t, 17), math3d.tostring(buffer[5]))
+end
+
+print "===OUTPUT==="
+do
+	local t = {}
+	print("totable", math3d.totable(ref1, t) == t, #t, t.type)
+	math3d.totable(math3d.vector(1,2,3), t)
+	print("refill", #t, t.type, t[1], t[2], t[3], t[4])
+	print("unpack", math3d.unpack(math3d.quaternion(0, 0, 0, 1)))
+	local axes = math3d.array("v", 2)
+	math3d.base_axes(math3d.vector(0, 0, 1), axes)
+	print("base_axes", math3d.tostring(axes[1]), math3d.tostring(axes[2]))
+end
+
+print "===SERIALIZE==="
+do
+	local q = math3d.quaternion { axis = {0,1,0}, r = math.rad(60) }
+	local arr = math3d.array("v", 2)
+	arr:copy { {1,2,3}, {4,5,6} }
+	local s = math3d.serialize(math3d.vector(1,2,3), q, ref1, arr)
+	local v, q2, m, arr2 = math3d.deserialize(s)
+	print("raw", #s, math3d.tostring(v), math3d.tostring(q2), math3d.tostring(m), math3d.tostring(arr2[2]))
+	local qs = math3d.serialize({ quat = true, position = true }, math3d.vector(1.1, 2.2, 3.3), q)
+	local pos, rot = math3d.deserialize(qs, "ref")
+	print("quantized", #qs, pos, rot, math3d.tostring(q))
+	print("half overflow", pcall(math3d.serialize, { position = true }, math3d.vector(70000, 0, 0)))
+	local ws = math3d.serialize({ position = { origin = { 50000, 0, -50000 }, range = 100000 } }, math3d.vector(123456.7, 8.9, -98765.4))
+	print("ranged", #ws, math3d.tostring(math3d.deserialize(ws)))
+	local target = { math3d.ref(), math3d.ref(), math3d.ref(), math3d.array("v", 2) }
+	print("target", math3d.deserialize(s, target), target[1], target[3], math3d.tostring(target[4][1]))
+	print("version", pcall(math3d.deserialize, s:sub(2)))
+end
+
+print "===PROGRAM==="
+do
+	local prog = math3d.program {
+		input = "mvvn",
+		{ "lookat", 2, 3 },	-- 5 : view matrix
+		{ "mul", 1, 5 },	-- 6 : viewproj
+		{ "mul", 4, 3 },	-- 7 : scale target
+		{ "transformH", 6, 7 },	-- 8
+		output = { 8, 6 },
+	}
+	local eye = math3d.vector { 0, 5, -10 }
+	local at = math3d.vector { 1, 2, 3, 1 }
+	local p, viewproj = prog(projmat, eye, at, 0.5)
+	print("program", math3d.tostring(p), math3d.tostring(viewproj))
+	print("lua", math3d.tostring(math3d.transformH(math3d.mul(projmat, math3d.lookat(eye, at)), math3d.mul(0.5, at))))
+	local points = prog:batch(3, projmat, eye, { at, math3d.vector { 4,5,6,1 }, { 7,8,9,1 } }, { 1, 2, 3 })
+	for i = 1, 3 do
+		print("batch", i, math3d.tostring(points[i]))
+	end
+end
+
 print "===ADAPTER==="
 local adapter = require "math3d.adapter"
 local testfunc = require "math3d.adapter.test"
@@ -154,6 +373,7 @@ local format = adapter.format(testfunc.variant, testfunc.format, 2)
 local mvq = adapter.getter(testfunc.getmvq, "mvq")	-- getmvq will return matrix, vector, quat
 local matrix2_v = adapter.format(testfunc.matrix2, "mm", 1)
 local retvec = adapter.output_vector(testfunc.retvec, 1)
+local vector_array = adapter.array(testfunc.vector_array, 1, "v")	-- convert table of vector to (pointer, n)
 print(vector(ref2, math3d.vector{1,2,3}))
 print(matrix1(ref1))
 print(matrix2(ref1,ref1))
@@ -161,10 +381,103 @@ print(matrix2_v(ref1,ref1))
 print(matrix(ref1,ref1))
 print(var(ref1))
 print(var(ref2))
+print(var(math3d.affine(ref1)), var(math3d.dualquat(ref1)))
 print(format("mv", ref1, ref2))
 local m,v, q = mvq()
 print(math3d.tostring(m), math3d.tostring(v), math3d.tostring(q))
 
 local v1,v2 =retvec()
 print(math3d.tostring(v1), math3d.tostring(v2))
+print(vector_array { ref2, math3d.vector{1,2,3}, {4,5,6} })
+do
+	local arr = math3d.array("v", 2)
+	arr:copy { {1,2,3}, {4,5,6} }
+	print(vector_array(arr))
+end
 
+do
+	local eye, at = math3d.vector{0, 5, -10}, math3d.vector{0, 0, 0}
+	print("api lookat", math3d.tostring(testfunc.api_lookat(eye, at)), math3d.tostring(math3d.lookat(eye, at)))
+end
+
+print "===FASTMATH==="
+local fastmath = require "math3d.fastmath"
+print("fastmath.mul", math3d.tostring(fastmath.mul(ref1, ref1)), math3d.tostring(math3d.mul(ref1, ref1)))
+print("fastmath.cross", math3d.tostring(fastmath.cross(ref2, math3d.vector(0,1,0))))
+print("fastmath.lookat", math3d.tostring(fastmath.lookat(math3d.vector{0,5,-10}, math3d.vector{0,0,0}, math3d.vector{0,1,0})))
+
+print "===DOUBLE==="
+do
+	local double = require "math3d.double"
+	local world = double.matrix(math3d.matrix { r = { axis = {0,1,0}, r = math.rad(90) } }, { 100000.25, 0, 200000.5 })
+	local camera = double.vector { 100000, 0, 200000 }
+	local p = double.mul(world, double.vector(1, 2, 3, 1))
+	print("dvec", p)
+	print("relative", math3d.tostring(double.tofloat(world, camera)), math3d.tostring(double.tofloat(p, camera)))
+	print("direction", math3d.tostring(double.tofloat(double.vector(0, 1, 0, 0), camera)))
+	local inv = double.inverse(world)
+	print("inverse", math3d.tostring(double.tofloat(double.mul(inv, p))))
+	print("sub", table.concat(double.totable(double.sub(p, camera)), ","))
+end
+
+print "===REBASE==="
+do
+	local worlds = math3d.array("m", 2)
+	worlds[1] = math3d.matrix { t = { 100000, 0, 200000 } }
+	worlds[2] = math3d.matrix { s = 2, t = { 100010, 5, 200000 } }
+	local low = math3d.array("v", 2)
+	low[1] = math3d.vector(0.25, 0, 0.5)
+	low[2] = math3d.vector(0, 0, 0.125)
+	local origin = { 100000, 0, 200000 }
+	local view = math3d.lookto(math3d.vector(0, 0, 0), math3d.vector(1, 0, 0))
+	local world, worldview = math3d.array("m", 2), math3d.array("m", 2)
+	math3d.rebase_array(worlds, low, origin, world, view, worldview)
+	print("hilo", math3d.tostring(world[1]), math3d.tostring(worldview[2]))
+	local doubles = string.pack("=" .. string.rep("d", 16), 1,0,0,0, 0,1,0,0, 0,0,1,0, 100000.25,0,200000.5,1)
+	math3d.rebase_array(doubles, origin, world)
+	print("double", math3d.tostring(world[1]))
+end
+
+print "===AFFINE==="
+do
+	local a = math3d.affine { s = 2, r = { axis = {0,1,0}, r = math.rad(90) }, t = { 1, 2, 3 } }
+	print("affine", math3d.tostring(a), math3d.tostring(math3d.matrix(a)))
+	local b = math3d.mul(a, a)
+	print("mul", math3d.tostring(b), math3d.tostring(math3d.mul(math3d.matrix(a), math3d.matrix(a))))
+	print("inverse", math3d.tostring(math3d.mul(a, math3d.inverse(a))))
+	print("transform", math3d.tostring(math3d.transform(a, math3d.vector(1, 0, 0), 1)))
+	local proj = math3d.projmat { fov = 60, aspect = 1, n = 0.1, f = 100 }
+	print("projection", math3d.tostring(math3d.mul(proj, a)))
+	local r = math3d.ref(a)
+	r.t = { 4, 5, 6 }
+	print("ref", math3d.tostring(r), math3d.tostring(r.t), math3d.tostring(math3d.index(r, 4)))
+	local arr = math3d.array("a", 2)
+	arr[2] = a
+	print("array", arr, math3d.tostring(arr[2]), math3d.stacksize())
+end
+
+print "===DUALQUAT==="
+do
+	local m = math3d.matrix { r = { axis = {0,1,0}, r = math.rad(90) }, t = { 1, 2, 3 } }
+	local dq = math3d.dualquat(m)
+	print("dualquat", math3d.tostring(dq), math3d.tostring(math3d.matrix(dq)))
+	print("srt", math3d.tostring(math3d.dualquat { r = { axis = {0,1,0}, r = math.rad(90) }, t = { 1, 2, 3 } }))
+	local s, r, t = math3d.srt(dq)
+	print("decompose", math3d.tostring(s), math3d.tostring(r), math3d.tostring(t))
+	print("mul", math3d.tostring(math3d.matrix(math3d.mul(dq, dq))), math3d.tostring(math3d.mul(m, m)))
+	print("inverse", math3d.tostring(math3d.normalize(math3d.mul(dq, math3d.inverse(dq)))))
+	print("transform", math3d.tostring(math3d.transform(dq, math3d.vector(1, 0, 0), 1)))
+	local points = math3d.array("v", 2)
+	points[1] = math3d.vector(1, 0, 0, 1)
+	points[2] = math3d.vector(0, 1, 0, 1)
+	math3d.transform_array(dq, points)
+	print("transform_array", math3d.tostring(points[1]), math3d.tostring(points[2]))
+	local mats = math3d.array("m", 2)
+	mats[1] = m
+	local palette = math3d.array("d", 2)
+	math3d.dualquat_array(mats, palette)
+	print("palette", math3d.tostring(palette[1]), math3d.tostring(palette[2]), #math3d.dualquat_array(mats))
+	local s2 = math3d.serialize(dq, palette)
+	local dq2, palette2 = math3d.deserialize(s2)
+	print("serialize", math3d.tostring(dq2), palette2)
+end
@@ -3,6 +3,8 @@
 #include <lua.h>
 #include <lauxlib.h>
 
+#include "math3d.h"
+
 static int
 lvector(lua_State *L) {
 	int top = lua_gettop(L);
@@ -104,6 +106,39 @@ lretvector(lua_State *L) {
 	return 2;
 }
 
+// (pointer, n) of vec4 : returns n, sum of x
+static int
+lvector_array(lua_State *L) {
+	const float *v = (const float *)lua_touserdata(L, 1);
+	int n = (int)luaL_checkinteger(L, 2);
+	int i;
+	float sum = 0;
+	for (i=0;i<n;i++) {
+		sum += v[i*4];
+	}
+	lua_pushinteger(L, n);
+	lua_pushnumber(L, sum);
+	return 2;
+}
+
+// use math3d_api : lookat(eye, at) returns math3d id
+static int
+lapi_lookat(lua_State *L) {
+	if (lua_getfield(L, LUA_REGISTRYINDEX, MATH3D_STACK) != LUA_TUSERDATA)
+		return luaL_error(L, "request 'math3d' first");
+	struct boxstack *bs = (struct boxstack *)lua_touserdata(L, -1);
+	const struct math3d_api *api = bs->api;
+	if (api->version < MATH3D_API_VERSION)
+		return luaL_error(L, "Invalid math3d api version %d", api->version);
+	int64_t eye = (int64_t)lua_touserdata(L, 1);
+	int64_t at = (int64_t)lua_touserdata(L, 2);
+	int64_t id = api->op(bs->LS, MATH3D_OP_LOOKAT, eye, at, 0);
+	if (id == 0)
+		return luaL_error(L, "Invalid lookat arguments");
+	lua_pushlightuserdata(L, (void *)id);
+	return 1;
+}
+
 LUAMOD_API int
 luaopen_math3d_adapter_test(lua_State *L) {
 	luaL_checkversion(L);
@@ -115,6 +150,8 @@ luaopen_math3d_adapter_test(lua_State *L) {
 		{ "variant", lvariant },
 		{ "getmvq", lgetmvq },
 		{ "retvec", lretvector },
+		{ "api_lookat", lapi_lookat },
+		{ "vector_array", lvector_array },
 		{ NULL, NULL },
 	};
 	luaL_newlib(L, l);
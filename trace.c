@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "gettime.h"
+
+#if defined(_MSC_VER)
+
+#include <intrin.h>
+#define THREAD_LOCAL __declspec(thread)
+#define ATOMIC_INC(p) ((uint64_t)_InterlockedIncrement64((volatile __int64 *)(p)) - 1)
+
+#else
+
+#define THREAD_LOCAL __thread
+#define ATOMIC_INC(p) __atomic_fetch_add((p), 1, __ATOMIC_RELAXED)
+
+#endif
+
+struct trace_event {
+	const char *name;
+	uint64_t ts;
+	uint64_t dur;
+	int64_t arg;
+	uint32_t tid;
+	char phase;
+};
+
+int math3d_trace_enabled = 0;
+
+static struct trace_event *g_events = NULL;
+static uint64_t g_mask = 0;
+static uint64_t g_head = 0;	// total events written
+static uint64_t g_base = 0;	// time of math3d_trace_start
+static uint64_t g_thread = 0;	// 64 bits for ATOMIC_INC
+static THREAD_LOCAL uint32_t t_tid = 0;
+
+int
+math3d_trace_start(int capacity) {
+	uint64_t cap = 1;
+	while (cap < (uint64_t)capacity)
+		cap *= 2;
+	math3d_trace_enabled = 0;
+	if (cap != g_mask + 1 || g_events == NULL) {
+		free(g_events);
+		g_events = (struct trace_event *)malloc(cap * sizeof(*g_events));
+		if (g_events == NULL) {
+			g_mask = 0;
+			return 0;
+		}
+		g_mask = cap - 1;
+	}
+	g_head = 0;
+	g_base = gettime_ns();
+	math3d_trace_enabled = 1;
+	return 1;
+}
+
+void
+math3d_trace_stop() {
+	math3d_trace_enabled = 0;
+}
+
+uint64_t
+math3d_trace_time() {
+	return gettime_ns();
+}
+
+void
+math3d_trace_event(const char *name, char phase, uint64_t ts, uint64_t dur, int64_t arg) {
+	if (t_tid == 0)
+		t_tid = (uint32_t)ATOMIC_INC(&g_thread) + 1;
+	struct trace_event *e = &g_events[ATOMIC_INC(&g_head) & g_mask];
+	e->name = name;
+	e->ts = ts;
+	e->dur = dur;
+	e->arg = arg;
+	e->tid = t_tid;
+	e->phase = phase;
+}
+
+// dump when no thread is writing events
+int
+math3d_trace_dump(const char *filename) {
+	if (g_events == NULL)
+		return -1;
+	FILE *f = fopen(filename, "w");
+	if (f == NULL)
+		return -1;
+	uint64_t head = g_head;
+	uint64_t from = head > g_mask + 1 ? head - g_mask - 1 : 0;
+	uint64_t i;
+	fprintf(f, "{\"traceEvents\":[\n");
+	for (i=from;i<head;i++) {
+		const struct trace_event *e = &g_events[i & g_mask];
+		double ts = e->ts >= g_base ? (double)(e->ts - g_base) / 1000.0 : 0;
+		fprintf(f, "{\"name\":\"%s\",\"cat\":\"math3d\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+			e->name, e->phase, ts, (unsigned)e->tid);
+		if (e->phase == 'X')
+			fprintf(f, ",\"dur\":%.3f", (double)e->dur / 1000.0);
+		else if (e->phase == 'i')
+			fprintf(f, ",\"s\":\"t\"");
+		fprintf(f, ",\"args\":{\"n\":%lld}}%s\n", (long long)e->arg, i + 1 < head ? "," : "");
+	}
+	fprintf(f, "]}\n");
+	fclose(f);
+	return (int)(head - from);
+}
@@ -0,0 +1,24 @@
+#ifndef math3d_trace_h
+#define math3d_trace_h
+
+#include <stdint.h>
+
+// Chrome trace events (chrome://tracing or perfetto) of math3d activity, off by default.
+// Events are written into a lock-free ring buffer shared by all threads, the oldest events are overwritten.
+
+extern int math3d_trace_enabled;
+
+int math3d_trace_start(int capacity);	// capacity is rounded up to a power of 2, returns 0 if failed
+void math3d_trace_stop();
+uint64_t math3d_trace_time();
+void math3d_trace_event(const char *name, char phase, uint64_t ts, uint64_t dur, int64_t arg);	// name must be a static string
+int math3d_trace_dump(const char *filename);	// returns the number of events, -1 if failed
+
+// begin time of a complete event, 0 when the tracer is off
+#define MATH3D_TRACE_BEGIN() (math3d_trace_enabled ? math3d_trace_time() : 0)
+// complete event ('X') from begin time t, an error between begin and end drops the event
+#define MATH3D_TRACE_END(name, t, arg) do { if (t) math3d_trace_event(name, 'X', t, math3d_trace_time() - (t), arg); } while (0)
+// instant event ('i')
+#define MATH3D_TRACE_MARK(name, arg) do { if (math3d_trace_enabled) math3d_trace_event(name, 'i', math3d_trace_time(), 0, arg); } while (0)
+
+#endif